@@ -0,0 +1,351 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+/// @file LOTBench.cpp Micro-benchmarks of the CPU and allocation cost of the LOTPortDriver hot paths.
+///
+/// Runs against the simulated SDK with its latency model switched off, so the numbers are the
+/// driver's own overhead; the bare SDK call is timed too (sdk_get) for reference. The system model
+/// is generated with enough filter wheel positions and gratings to give hundreds of parameters.
+///
+/// The poll sweep and the parameter reads must not allocate once warmed up, so an IOC that runs for months
+/// does not churn the heap; if any of them does LOTBench says so and exits with status 2.
+///
+/// usage: LOTBench [-n iterations] [-w wheels] [-p positions] [-g gratings] [-o file.csv]
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <list>
+#include <map>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+#include "asynPortDriver.h"
+
+#include "LOTUtils.h"
+#include "LOTHWSim.h"
+#include "LOTStats.h"
+#include "LOTHistory.h"
+#include "LOTParam.h"
+#include "LOTSdkQueue.h"
+#include "LOTTransitionModel.h"
+#include "LOTCalibration.h"
+#include "LOTLayout.h"
+#include "LOTPortDriver.h"
+
+static std::atomic<long> allocations(0);
+static std::atomic<long> allocated_bytes(0);
+
+void* operator new(size_t n)
+{
+	++allocations;
+	allocated_bytes += static_cast<long>(n);
+	void* p = malloc(n > 0 ? n : 1);
+	if (p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t n)
+{
+	return operator new(n);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+namespace {
+
+	struct BenchResult
+	{
+		std::string name;
+		long iterations;
+		double ns_per_op;
+		double allocs_per_op;
+		double bytes_per_op;
+	};
+
+	std::vector<BenchResult> results;
+
+	/// benchmarks of hot paths that must make no heap allocation
+	const char* no_alloc[] = { "sdk_get_handle", "param_read_real", "param_read_string", "readFloat64_cached", "readOctet_cached",
+		"readFloat64", "readOctet", "updateValues_sweep", "try_get_error" };
+
+	template <typename F>
+	void bench(const char* name, long iterations, F f)
+	{
+		for (long i = 0; i < 10; ++i) // warm up
+		{
+			f();
+		}
+		long a0 = allocations, b0 = allocated_bytes;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (long i = 0; i < iterations; ++i)
+		{
+			f();
+		}
+		double t = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		long a = allocations - a0, b = allocated_bytes - b0; // before the result's name is copied, which may allocate
+		BenchResult r = { name, iterations, t / iterations, static_cast<double>(a) / iterations, static_cast<double>(b) / iterations };
+		results.push_back(r);
+		printf("%-28s %10ld %14.1f %10.2f %12.1f\n", r.name.c_str(), r.iterations, r.ns_per_op, r.allocs_per_op, r.bytes_per_op);
+	}
+
+	/// a filter wheel heavy monochromator, to give a realistic number of parameters to sweep
+	void writeConfig(const char* file, int wheels, int positions, int gratings)
+	{
+		std::ofstream xml(file);
+		xml << "<?xml version=\"1.0\"?>\n<system>\n<comms id=\"usb1\" type=\"usb\" group=\"1\">\n";
+		xml << "<monochromator id=\"mono1\">\n<TurretNumGratings>" << gratings << "</TurretNumGratings>\n";
+		for (int g = 1; g <= gratings; ++g)
+		{
+			xml << "<GratingSwitchWL index=\"" << g << "\">" << (g - 1) * 300 << "</GratingSwitchWL>\n";
+		}
+		for (int w = 1; w <= wheels; ++w)
+		{
+			xml << "<filterwheel id=\"fwheel" << w << "\">\n<FWheelPositions>" << positions << "</FWheelPositions>\n";
+			for (int p = 1; p <= positions; ++p)
+			{
+				xml << "<FWheelFilter index=\"" << p << "\">" << (p - 1) * 100 << "</FWheelFilter>\n";
+			}
+			xml << "</filterwheel>\n";
+		}
+		xml << "</monochromator>\n</comms>\n</system>\n";
+	}
+
+	class LOTBenchDriver : public LOTPortDriver
+	{
+	public:
+		LOTBenchDriver(const char* config_file, const char* subst_file) : LOTPortDriver("LOTBENCH", config_file, subst_file, true) { }
+
+		/// stop the background poller so it does not run, or allocate, during measurements
+		void stopPoller()
+		{
+			m_shutdown_requested = true;
+			epicsThreadSleep(1.0);
+		}
+
+		size_t numParams() const { return m_lot_params.size(); }
+
+		LOTParam* firstParam(LOTParam::ParamType type)
+		{
+			for (auto it = m_lot_params.begin(); it != m_lot_params.end(); ++it)
+			{
+				if (it->type() == type)
+				{
+					return &*it;
+				}
+			}
+			throw std::runtime_error("LOTBench: no parameter of the required type");
+		}
+
+		/// the lookup readFloat64() and readOctet() make before calling read()
+		LOTParam* lookup(int function)
+		{
+			return findLOTParam(function);
+		}
+
+		void openSubst(const char* file) { m_subst_file.open(file, std::ios::out); }
+		void closeSubst() { m_subst_file.close(); }
+
+		using LOTPortDriver::addRealParam;
+		using LOTPortDriver::addStringParam;
+	};
+
+	void usage()
+	{
+		std::cerr << "usage: LOTBench [-n iterations] [-w wheels] [-p positions] [-g gratings] [-o file.csv]" << std::endl;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	long n = 100000;
+	int wheels = 8, positions = 32, gratings = 8;
+	const char* csv_file = NULL;
+	const char* config_file = "LOTBench_config.xml";
+	const char* subst_file = "LOTBench.substitutions";
+	for (int i = 1; i < argc; ++i)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "-n"))
+		{
+			n = atol(argv[++i]);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-w"))
+		{
+			wheels = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-p"))
+		{
+			positions = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-g"))
+		{
+			gratings = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-o"))
+		{
+			csv_file = argv[++i];
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (n < 1)
+	{
+		usage();
+		return 1;
+	}
+	int status = 0;
+	try
+	{
+		LOTSim_set_latency("scale", 0.0);
+		writeConfig(config_file, wheels, positions, gratings);
+		LOTBenchDriver* driver = new LOTBenchDriver(config_file, subst_file);
+		driver->stopPoller();
+		size_t nparams = driver->numParams();
+		long sweeps = (n / static_cast<long>(nparams) > 0 ? n / static_cast<long>(nparams) : 1);
+		printf("LOTBench: %lu parameters\n\n", static_cast<unsigned long>(nparams));
+		printf("%-28s %10s %14s %10s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op");
+
+		LOTParam* real_param = driver->firstParam(LOTParam::Real);
+		LOTParam* string_param = driver->firstParam(LOTParam::String);
+		LOTParam* writable_param = NULL;
+		int writable_id;
+		if (driver->findParam("fwheel1_lotMoveWithWavelength", &writable_id) == asynSuccess)
+		{
+			writable_param = driver->lookup(writable_id);
+		}
+		double d;
+		bench("sdk_get", n, [&]() { LOTUtils::get("mono1", MonochromatorCurrentWL, 0, d); });
+		LOTHandle handle = { LOTUtils::intern("mono1"), MonochromatorCurrentWL, 0 };
+		bench("sdk_get_handle", n, [&]() { LOTUtils::get(handle, d); });
+		bench("param_read_real", n, [&]() { real_param->read(); });
+		bench("param_read_string", n, [&]() { string_param->read(); });
+		if (writable_param != NULL)
+		{
+			bench("param_write_real", n, [&]() { writable_param->write(); });
+		}
+		LOTParam* volatile found = NULL; // keeps the lookup from being optimised away
+		bench("param_lookup", n, [&]() { found = driver->lookup(real_param->id()); });
+
+		asynUser* pasynUser = pasynManager->createAsynUser(NULL, NULL);
+		pasynManager->connectDevice(pasynUser, "LOTBENCH", 0);
+		char buffer[256];
+		size_t nactual;
+		int eom;
+		pasynUser->reason = real_param->id();
+		bench("readFloat64_cached", n, [&]() { driver->readFloat64(pasynUser, &d); });
+		pasynUser->reason = string_param->id();
+		bench("readOctet_cached", n, [&]() { driver->readOctet(pasynUser, buffer, sizeof(buffer), &nactual, &eom); });
+		driver->setCacheMaxAge(0.0);
+		pasynUser->reason = real_param->id();
+		bench("readFloat64", n, [&]() { driver->readFloat64(pasynUser, &d); });
+		pasynUser->reason = string_param->id();
+		bench("readOctet", n, [&]() { driver->readOctet(pasynUser, buffer, sizeof(buffer), &nactual, &eom); });
+
+		const LOTTransitionModel& model = driver->transitionModel();
+		int volatile predicted = 0; // keeps the prediction from being optimised away
+		bench("transition_changes", n, [&]() { predicted = model.changes(450.0, 1550.0); });
+
+		bench("updateValues_sweep", sweeps, [&]() { driver->updateValues(); });
+		printf("%-28s %10s %14.1f\n", "  per parameter", "", results.back().ns_per_op / nparams);
+
+		std::list<std::string> splits;
+		std::string list_str = "mono1,fwheel1,fwheel2,sam1,slit1,,slit2,";
+		bench("split_string", n, [&]() { LOTUtils::split_string(list_str, splits); });
+
+		bench("lot_check_throw", n / 10 + 1, [&]() {
+			try
+			{
+				LOTUtils::get("no_such_item", MonochromatorCurrentWL, 0, d);
+			}
+			catch (const LOTException&)
+			{
+			}
+		});
+		LOTHandle bad_handle = { LOTUtils::intern("no_such_item"), MonochromatorCurrentWL, 0 };
+		LOTError error;
+		bench("try_get_error", n, [&]() { LOTUtils::try_get(bad_handle, d, error); });
+
+		// each iteration creates a new asyn parameter, so keep the count down
+		long nadd = (n / 100 > 0 ? n / 100 : 1);
+		int counter = 0;
+		driver->openSubst("LOTBench_add.substitutions");
+		bench("addRealParam", nadd, [&]() {
+			++counter;
+			driver->addRealParam("bench" + std::to_string(counter), FWheelFilter, false, counter);
+		});
+		bench("addStringParam", nadd, [&]() {
+			++counter;
+			driver->addStringParam("bench" + std::to_string(counter), lotDescriptor);
+		});
+		driver->closeSubst();
+		remove("LOTBench_add.substitutions");
+
+		for (auto r = results.cbegin(); r != results.cend(); ++r)
+		{
+			for (size_t i = 0; i < sizeof(no_alloc) / sizeof(no_alloc[0]); ++i)
+			{
+				if (r->name == no_alloc[i] && r->allocs_per_op > 0.0)
+				{
+					fprintf(stderr, "LOTBench: %s makes %.2f allocations per call, expected none\n", r->name.c_str(), r->allocs_per_op);
+					status = 2;
+				}
+			}
+		}
+
+		if (csv_file != NULL)
+		{
+			FILE* fp = fopen(csv_file, "w");
+			if (fp == NULL)
+			{
+				std::cerr << "cannot write " << csv_file << std::endl;
+				return 1;
+			}
+			fprintf(fp, "benchmark,iterations,ns_per_op,allocs_per_op,bytes_per_op\n");
+			for (auto r = results.cbegin(); r != results.cend(); ++r)
+			{
+				fprintf(fp, "%s,%ld,%.1f,%.2f,%.1f\n", r->name.c_str(), r->iterations, r->ns_per_op, r->allocs_per_op, r->bytes_per_op);
+			}
+			fclose(fp);
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "LOTBench: " << ex.what() << std::endl;
+		return 1;
+	}
+	return status;
+}
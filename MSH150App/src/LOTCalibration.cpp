@@ -0,0 +1,187 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include <errlog.h>
+#include <epicsStdio.h>
+
+#include <epicsExport.h>
+
+#include "LOTUtils.h"
+#include "LOTCalibration.h"
+
+/// Add a reference line at \a measured nm that grating \a grating shows at \a nominal nm
+void LOTCalibration::addPoint(int grating, double nominal, double measured)
+{
+	if (grating < 1)
+	{
+		throw std::runtime_error("LOT calibration: invalid grating " + std::to_string(grating));
+	}
+	Point p = { grating, nominal, measured };
+	m_points.push_back(p);
+}
+
+/// Add the points in \a file, one "grating nominal measured" per line; blank lines and those starting with # are ignored
+void LOTCalibration::load(const std::string& file)
+{
+	std::ifstream is(file.c_str());
+	if (!is.good())
+	{
+		throw std::runtime_error("LOT calibration: cannot open \"" + file + "\"");
+	}
+	std::string line;
+	for (int n = 1; std::getline(is, line); ++n)
+	{
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+		{
+			continue;
+		}
+		std::istringstream iss(line);
+		int grating = 0;
+		double nominal = 0.0, measured = 0.0;
+		if (!(iss >> grating >> nominal >> measured))
+		{
+			throw std::runtime_error("LOT calibration: \"" + file + "\" line " + std::to_string(n) +
+				" is not \"grating nominal measured\"");
+		}
+		addPoint(grating, nominal, measured);
+	}
+}
+
+/// Fit the zero order offset of each grating with points, replacing any previous fit
+void LOTCalibration::fit()
+{
+	if (m_points.empty())
+	{
+		throw std::runtime_error("LOT calibration: no points to fit");
+	}
+	m_fits.clear();
+	for (std::vector<Point>::const_iterator p = m_points.begin(); p != m_points.end(); ++p)
+	{
+		std::vector<Fit>::iterator f = m_fits.begin();
+		while (f != m_fits.end() && f->grating < p->grating)
+		{
+			++f;
+		}
+		if (f == m_fits.end() || f->grating != p->grating)
+		{
+			Fit nf = { p->grating, 0, 0.0, 0.0, 0.0, 0, 0 };
+			f = m_fits.insert(f, nf);
+		}
+		++f->points;
+		f->nominal += p->nominal;
+		f->offset += p->measured - p->nominal;
+	}
+	for (std::vector<Fit>::iterator f = m_fits.begin(); f != m_fits.end(); ++f)
+	{
+		f->nominal /= f->points;
+		f->offset /= f->points;
+	}
+	for (std::vector<Point>::const_iterator p = m_points.begin(); p != m_points.end(); ++p)
+	{
+		for (std::vector<Fit>::iterator f = m_fits.begin(); f != m_fits.end(); ++f)
+		{
+			if (f->grating == p->grating)
+			{
+				double r = p->measured - p->nominal - f->offset;
+				f->residual += r * r;
+			}
+		}
+	}
+	for (std::vector<Fit>::iterator f = m_fits.begin(); f != m_fits.end(); ++f)
+	{
+		f->residual = sqrt(f->residual / f->points);
+	}
+}
+
+/// Recalibrate every fitted grating of monochromator \a mono; must be called on the SDK thread. Either all are
+/// recalibrated or, if one fails, those done already are set back to their old zero order and the error rethrown.
+/// The new zero orders are not saved to the SDK setup until save_setup(), e.g. by rollback() or a SAVESETUP write.
+/// Refused while a calibration is applied, as applying another would lose the zero orders rollback() restores.
+void LOTCalibration::apply(const std::string& mono)
+{
+	if (m_fits.empty())
+	{
+		throw std::runtime_error("LOT calibration: nothing fitted to apply");
+	}
+	if (!m_applied.empty())
+	{
+		throw std::runtime_error("LOT calibration: roll back the last calibration before applying another");
+	}
+	size_t done = 0;
+	try
+	{
+		for (; done < m_fits.size(); ++done)
+		{
+			Fit& f = m_fits[done];
+			LOTUtils::recalibrate(mono, f.grating, f.nominal, f.nominal + f.offset, f.old_zord, f.new_zord);
+		}
+	}
+	catch (const std::exception&)
+	{
+		for (size_t i = 0; i < done; ++i)
+		{
+			try
+			{
+				LOTUtils::set(mono, LOTTokens::GratingZord, m_fits[i].grating, m_fits[i].old_zord);
+			}
+			catch (const std::exception& ex)
+			{
+				errlogSevPrintf(errlogMajor, "LOT: cannot restore zero order of grating %d of %s: %s\n", m_fits[i].grating, mono.c_str(), ex.what());
+			}
+		}
+		throw;
+	}
+	m_applied = m_fits;
+}
+
+/// Set the gratings of monochromator \a mono back to their zero orders before apply(), and save_setup() so the SDK
+/// setup holds them again even if the new ones were saved; must be called on the SDK thread
+void LOTCalibration::rollback(const std::string& mono)
+{
+	if (m_applied.empty())
+	{
+		throw std::runtime_error("LOT calibration: nothing applied to roll back");
+	}
+	for (std::vector<Fit>::const_iterator f = m_applied.begin(); f != m_applied.end(); ++f)
+	{
+		LOTUtils::set(mono, LOTTokens::GratingZord, f->grating, f->old_zord);
+	}
+	LOTUtils::save_setup();
+	m_applied.clear();
+}
+
+/// A table of the fits, or of those last applied if \a applied, one line per grating
+std::string LOTCalibration::describe(bool applied) const
+{
+	const std::vector<Fit>& fits = (applied ? m_applied : m_fits);
+	std::ostringstream oss;
+	char buffer[128];
+	for (std::vector<Fit>::const_iterator f = fits.begin(); f != fits.end(); ++f)
+	{
+		epicsSnprintf(buffer, sizeof(buffer), "grating %d: %d points about %.3f nm, offset %+.4f nm, residual %.4f nm", f->grating,
+			f->points, f->nominal, f->offset, f->residual);
+		oss << buffer;
+		if (applied)
+		{
+			oss << ", zero order " << f->old_zord << " -> " << f->new_zord;
+		}
+		oss << "\n";
+	}
+	return oss.str();
+}
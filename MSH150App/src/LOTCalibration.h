@@ -0,0 +1,59 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTCALIBRATION_H
+#define LOTCALIBRATION_H
+
+/// Zero order recalibration of the gratings of a monochromator against reference lines.
+///
+/// Each point is a line at \a measured nm that the monochromator shows at \a nominal nm on one grating. As
+/// LOTUtils::recalibrate() can only shift a grating's zero order, fit() finds the least squares offset for each
+/// grating, the mean of measured - nominal, and the RMS residual left after it. apply() then recalibrates every
+/// fitted grating in one go, keeping the old and new zero orders so that rollback() can restore them, even after
+/// the points are replaced and fitted again. Only one calibration can be applied at a time, so rollback() always
+/// returns to the zero orders from before it.
+class LOTCalibration
+{
+public:
+	struct Point
+	{
+		int grating;
+		double nominal;
+		double measured;
+	};
+
+	/// the correction of one grating, and its zero order before and after apply()
+	struct Fit
+	{
+		int grating;
+		int points;
+		double nominal; ///< mean nominal wavelength of its points, where apply() recalibrates
+		double offset; ///< measured - nominal
+		double residual; ///< RMS of measured - nominal - offset
+		int old_zord;
+		int new_zord;
+	};
+
+	void clear() { m_points.clear(); m_fits.clear(); }
+	void addPoint(int grating, double nominal, double measured);
+	void load(const std::string& file);
+	const std::vector<Point>& points() const { return m_points; }
+	void fit();
+	const std::vector<Fit>& fits() const { return m_fits; }
+	void apply(const std::string& mono);
+	void rollback(const std::string& mono);
+	/// the fits as of the last apply(), empty if none or it has been rolled back
+	const std::vector<Fit>& applied() const { return m_applied; }
+	std::string describe(bool applied = false) const;
+
+private:
+	std::vector<Point> m_points;
+	std::vector<Fit> m_fits; ///< by grating
+	std::vector<Fit> m_applied; ///< what rollback() restores
+};
+
+#endif /* LOTCALIBRATION_H */
@@ -1,49 +1,56 @@
 #ifndef LOTHW_H
 #define LOTHW_H
 
+/* LOTHW_SIMULATED is defined when building against the LOTHWSim.cpp stand-in rather than the vendor DLL */
+#if defined(_WIN32) && !defined(LOTHW_SIMULATED)
+#define LOTHW_API __declspec(dllimport)
+#else
+#define LOTHW_API
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-	__declspec(dllimport) int LOT_build_system_model(const char* xmlfile);
+	LOTHW_API int LOT_build_system_model(const char* xmlfile);
 
-	__declspec(dllimport) int LOT_close();
+	LOTHW_API int LOT_close();
 
-	__declspec(dllimport) int LOT_get(const char* id, int token, int _index, double *value);
+	LOTHW_API int LOT_get(const char* id, int token, int _index, double *value);
 
 	/* list needs to be pre-allocated and null terminated */
-	__declspec(dllimport) int LOT_get_comms_list(char* list);
+	LOTHW_API int LOT_get_comms_list(char* list);
 
 	/* list needs to be pre-allocated and null terminated */
-	__declspec(dllimport) int LOT_get_hardware_list(char* list);
+	LOTHW_API int LOT_get_hardware_list(char* list);
 
-	__declspec(dllimport) int LOT_get_hardware_type(const char* id, int *HardwareType);
+	LOTHW_API int LOT_get_hardware_type(const char* id, int *HardwareType);
 
 	/* ID needs to be pre-allocated and null terminated */
-	__declspec(dllimport) int LOT_get_last_error(int *ErrorCode, char* ID, int *Address);
+	LOTHW_API int LOT_get_last_error(int *ErrorCode, char* ID, int *Address);
 
 	/* ItemIDs needs to be pre-allocated and null terminated */
-	__declspec(dllimport) int LOT_get_mono_items(const char* monoID, char* ItemIDs);
+	LOTHW_API int LOT_get_mono_items(const char* monoID, char* ItemIDs);
 
 	/* s needs to be pre-allocated and null terminated */
-	__declspec(dllimport) int LOT_get_str(const char* id, int token, int _index, char* s);
+	LOTHW_API int LOT_get_str(const char* id, int token, int _index, char* s);
 
-	__declspec(dllimport) int LOT_initialise();
+	LOTHW_API int LOT_initialise();
 
-	__declspec(dllimport) int LOT_recalibrate(const char* ID, int _index, double Wavelength, double CorrectWavelength, int *OldZord, int *NewZord);
+	LOTHW_API int LOT_recalibrate(const char* ID, int _index, double Wavelength, double CorrectWavelength, int *OldZord, int *NewZord);
 
-	__declspec(dllimport) int LOT_save_setup();
+	LOTHW_API int LOT_save_setup();
 
-	__declspec(dllimport) int LOT_select_wavelength(double wl);
+	LOTHW_API int LOT_select_wavelength(double wl);
 
-	__declspec(dllimport) int LOT_set(const char* id, int token, int _index, const double *value);
+	LOTHW_API int LOT_set(const char* id, int token, int _index, const double *value);
 
-	__declspec(dllimport) int LOT_set_str(const char* id, int token, int _index, const char* s);
+	LOTHW_API int LOT_set_str(const char* id, int token, int _index, const char* s);
 
-	__declspec(dllimport) int LOT_set_c_group(int group);
+	LOTHW_API int LOT_set_c_group(int group);
 
 	/* Version needs to be pre-allocated and null terminated */
-	__declspec(dllimport) int LOT_version(char* Version);
+	LOTHW_API int LOT_version(char* Version);
 
 
 	//-----------------------------------------------------------------------------
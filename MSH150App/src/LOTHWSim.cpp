@@ -0,0 +1,815 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+/// @file LOTHWSim.cpp Stand-in for the vendor LotHW DLL, so the driver can be built and exercised on hosts without it.
+///
+/// The device tree comes from the same system model XML as the real SDK (see LOTSystemModel) and
+/// every call sleeps for a configurable time to mimic USB round trips and mechanical moves. Calls are
+/// serialised on one lock, as they would be on the single USB link. See LOTHWSim.h for configuration.
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+
+#include "LOTHWSim.h"
+#include "LOTSystemModel.h"
+
+#define LOTSIM_BUFFER_SIZE 256 ///< size of the caller supplied buffers, matches LOTUtils
+
+namespace {
+
+	struct ErrorRule
+	{
+		std::string op;
+		std::string id;
+		int token;
+		int code;
+		int count; ///< remaining failures, -1 for forever
+	};
+
+	struct SimState
+	{
+		std::mutex lock;
+		LOTSystemModel model;
+		bool built;
+		bool initialised;
+		int group;
+		int last_error;
+		std::string last_id;
+		int last_address;
+		std::map<std::string, double> latency;
+		std::map<std::pair<const char*, int>, double> token_latency; ///< tokenLatency() results, cleared when latency changes
+		std::vector<ErrorRule> errors;
+		std::map<std::string, long> calls;
+		bool env_applied;
+
+		SimState() : built(false), initialised(false), group(1), last_error(LOT_OK), last_address(0), env_applied(false)
+		{
+			latency["scale"] = 1.0;
+			latency["build_system_model"] = 0.2;
+			latency["initialise"] = 1.0;
+			latency["close"] = 0.05;
+			latency["get"] = 0.002;
+			latency["get_str"] = 0.002;
+			latency["set"] = 0.01;
+			latency["set_str"] = 0.01;
+			latency["select_wavelength"] = 0.05;
+			latency["save_setup"] = 0.1;
+			latency["recalibrate"] = 0.05;
+			latency["set_c_group"] = 0.001;
+			latency["query"] = 0.0;
+			latency["grating_change"] = 2.0;
+			latency["filter_change"] = 0.5;
+			latency["sam_change"] = 0.2;
+			latency["per_nm"] = 0.0005;
+			latency["timeout"] = 1.0;
+			latency["MonochromatorCurrentWL"] = 0.001;
+		}
+	};
+
+	SimState& sim()
+	{
+		static SimState state;
+		return state;
+	}
+
+	double latencyFor(SimState& s, const std::string& key, double def = 0.0)
+	{
+		std::map<std::string, double>::const_iterator it = s.latency.find(key);
+		return (it != s.latency.end() ? it->second : def);
+	}
+
+	/// looked up once for each call site and token, as building the std::string keys would allocate on every call
+	double tokenLatency(SimState& s, const char* op, int token)
+	{
+		std::pair<const char*, int> key(op, token);
+		std::map<std::pair<const char*, int>, double>::const_iterator it = s.token_latency.find(key);
+		if (it != s.token_latency.end())
+		{
+			return it->second;
+		}
+		const char* name = LOTSystemModel::token_name(token);
+		double def = latencyFor(s, op);
+		return (s.token_latency[key] = (name != NULL ? latencyFor(s, name, def) : def));
+	}
+
+	void delay(SimState& s, double seconds)
+	{
+		double t = seconds * latencyFor(s, "scale", 1.0);
+		if (t > 0.0)
+		{
+			std::this_thread::sleep_for(std::chrono::duration<double>(t));
+		}
+	}
+
+	int fail(SimState& s, int code, const char* id, int address = 0)
+	{
+		s.last_error = code;
+		s.last_id = (id != NULL ? id : "");
+		s.last_address = address;
+		if (code == LOT_Error_IMAC_timeout)
+		{
+			delay(s, latencyFor(s, "timeout"));
+		}
+		return code;
+	}
+
+	/// count the call and return any injected error for it
+	int begin(SimState& s, const char* op, const char* id = NULL, int token = -1)
+	{
+		++s.calls[op];
+		++s.calls["*"];
+		for (auto it = s.errors.begin(); it != s.errors.end(); ++it)
+		{
+			if ((it->op.empty() || it->op == op) &&
+				(it->id.empty() || (id != NULL && it->id == id)) &&
+				(it->token == -1 || it->token == token) && it->count != 0)
+			{
+				if (it->count > 0)
+				{
+					--(it->count);
+				}
+				return it->code;
+			}
+		}
+		return LOT_OK;
+	}
+
+	int copyOut(const std::string& value, char* buffer)
+	{
+		strncpy(buffer, value.c_str(), LOTSIM_BUFFER_SIZE - 1);
+		buffer[LOTSIM_BUFFER_SIZE - 1] = '\0';
+		return LOT_OK;
+	}
+
+	bool tokenValidFor(int type, int token)
+	{
+		if (token >= lotSettleDelay && token <= lotProductName)
+		{
+			return true;
+		}
+		switch (type)
+		{
+		case LOTSystemItem::Comms:
+			return token == SimulationMode;
+		case lotMono:
+			return (token >= MonochromatorScanDirection && token <= MonochromatorCosAlpha) || (token >= GratingDensity && token <= GratingBlaze);
+		case lotFilterWheel:
+			return token >= FWheelFilter && token <= FWheelCurrentPosition;
+		case lotSAM:
+			return token >= SAMInitialState && token <= SAMNoDeflectName;
+		case lotSlit:
+			return token >= MVSSSwitchWL && token <= MVSSCurrentBandwidth;
+		default:
+			return false;
+		}
+	}
+
+	double readValue(const LOTSystemItem& item, int token, int index)
+	{
+		switch (token)
+		{
+		case FWheelPositions:
+			return item.value(token, 0, item.max_index(FWheelFilter));
+		case TurretNumGratings:
+			return item.value(token, 0, std::max(item.max_index(GratingSwitchWL), 1));
+		case MonochromatorNumTurrets:
+		case MonochromatorCurrentGrating:
+		case MonochromatorAutoSelectWavelength:
+		case FWheelCurrentPosition:
+		case lotMoveWithWavelength:
+			return item.value(token, index, 1.0);
+		default:
+			return item.value(token, index, 0.0);
+		}
+	}
+
+	/// non-indexed attributes are stored at index 0, whatever index the caller passes
+	int keyIndex(int token, int index)
+	{
+		return (LOTSystemModel::is_indexed_token(token) ? index : 0);
+	}
+
+	int checkItem(SimState& s, const char* id, int token, int index, LOTSystemItem*& item)
+	{
+		if (!s.built)
+		{
+			return fail(s, LOT_System_Not_Initialised, id);
+		}
+		item = (id != NULL ? s.model.find(id) : NULL);
+		if (item == NULL)
+		{
+			return fail(s, LOT_Invalid_ID, id);
+		}
+		if (item->type != LOTSystemItem::Comms && !s.initialised)
+		{
+			return fail(s, LOT_System_Not_Initialised, id);
+		}
+		if (!tokenValidFor(item->type, token))
+		{
+			return fail(s, LOT_Invalid_Token, id);
+		}
+		if (LOTSystemModel::is_indexed_token(token))
+		{
+			int count = static_cast<int>(readValue(*item, (token == FWheelFilter ? FWheelPositions : TurretNumGratings), 0));
+			if (index < 1 || index > count)
+			{
+				return fail(s, LOT_Invalid_Index, id, index);
+			}
+		}
+		return LOT_OK;
+	}
+
+	/// highest position whose switch wavelength is at or below wl, or position 1
+	int selectIndex(const LOTSystemItem& item, int token, int count, double wl)
+	{
+		int selected = 1;
+		for (int i = 1; i <= count; ++i)
+		{
+			if (item.has(token, i) && item.value(token, i) <= wl)
+			{
+				selected = i;
+			}
+		}
+		return selected;
+	}
+
+	int parseToken(const std::string& s)
+	{
+		if (s.empty() || s == "*")
+		{
+			return -1;
+		}
+		if (isdigit(static_cast<unsigned char>(s[0])))
+		{
+			return atoi(s.c_str());
+		}
+		return LOTSystemModel::token_from_name(s);
+	}
+
+	int configureLatency(SimState& s, const std::string& spec)
+	{
+		std::vector<std::string> entries;
+		boost::split(entries, spec, boost::is_any_of(","), boost::token_compress_on);
+		for (auto e = entries.cbegin(); e != entries.cend(); ++e)
+		{
+			std::string entry = boost::trim_copy(*e);
+			if (entry.empty())
+			{
+				continue;
+			}
+			size_t eq = entry.find('=');
+			if (eq == std::string::npos)
+			{
+				return LOT_Invalid_Value;
+			}
+			s.latency[boost::trim_copy(entry.substr(0, eq))] = atof(entry.substr(eq + 1).c_str());
+			s.token_latency.clear();
+		}
+		return LOT_OK;
+	}
+
+	int configureErrors(SimState& s, const std::string& spec)
+	{
+		std::vector<std::string> rules;
+		boost::split(rules, spec, boost::is_any_of(";"), boost::token_compress_on);
+		for (auto r = rules.cbegin(); r != rules.cend(); ++r)
+		{
+			std::vector<std::string> f;
+			std::string rule = boost::trim_copy(*r);
+			if (rule.empty())
+			{
+				continue;
+			}
+			boost::split(f, rule, boost::is_any_of(","));
+			if (f.size() < 4)
+			{
+				return LOT_Invalid_Value;
+			}
+			for (auto it = f.begin(); it != f.end(); ++it)
+			{
+				boost::trim(*it);
+			}
+			ErrorRule e;
+			e.op = (f[0] == "*" ? "" : f[0]);
+			e.id = (f[1] == "*" ? "" : f[1]);
+			e.token = parseToken(f[2]);
+			e.code = atoi(f[3].c_str());
+			e.count = (f.size() > 4 ? atoi(f[4].c_str()) : 1);
+			s.errors.push_back(e);
+		}
+		return LOT_OK;
+	}
+
+}
+
+extern "C" {
+
+	int LOT_build_system_model(const char* xmlfile)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		s.calls.clear();
+		if (!s.env_applied)
+		{
+			const char* env = getenv("LOTSIM_LATENCY");
+			if (env != NULL)
+			{
+				configureLatency(s, env);
+			}
+			env = getenv("LOTSIM_ERRORS");
+			if (env != NULL)
+			{
+				configureErrors(s, env);
+			}
+			s.env_applied = true;
+		}
+		int rc = begin(s, "build_system_model");
+		delay(s, latencyFor(s, "build_system_model"));
+		if (rc != LOT_OK)
+		{
+			return fail(s, rc, NULL);
+		}
+		if (xmlfile == NULL || !std::ifstream(xmlfile).good())
+		{
+			return fail(s, LOT_File_Not_Found, NULL);
+		}
+		try
+		{
+			s.model.load(xmlfile);
+		}
+		catch (const std::exception&)
+		{
+			s.built = false;
+			return fail(s, LOT_Invalid_System_Model, NULL);
+		}
+		s.built = true;
+		s.initialised = false;
+		s.group = (s.model.comms().size() > 0 ? s.model.comms()[0].group : 1);
+		return LOT_OK;
+	}
+
+	int LOT_close()
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "close");
+		delay(s, latencyFor(s, "close"));
+		if (rc != LOT_OK)
+		{
+			return fail(s, rc, NULL);
+		}
+		s.built = s.initialised = false;
+		s.model.clear();
+		return LOT_OK;
+	}
+
+	int LOT_initialise()
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "initialise");
+		delay(s, latencyFor(s, "initialise"));
+		if (rc != LOT_OK)
+		{
+			return fail(s, rc, NULL);
+		}
+		if (!s.built)
+		{
+			return fail(s, LOT_Invalid_System_Model, NULL);
+		}
+		s.initialised = true;
+		return LOT_OK;
+	}
+
+	int LOT_get(const char* id, int token, int _index, double *value)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "get", id, token);
+		delay(s, tokenLatency(s, "get", token));
+		LOTSystemItem* item = NULL;
+		if (rc != LOT_OK || (rc = checkItem(s, id, token, _index, item)) != LOT_OK)
+		{
+			return fail(s, rc, id, _index);
+		}
+		if (LOTSystemModel::is_string_token(token))
+		{
+			return fail(s, LOT_Invalid_Attribute, id, _index);
+		}
+		*value = readValue(*item, token, keyIndex(token, _index));
+		return LOT_OK;
+	}
+
+	int LOT_set(const char* id, int token, int _index, const double *value)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "set", id, token);
+		delay(s, tokenLatency(s, "set", token));
+		LOTSystemItem* item = NULL;
+		if (rc != LOT_OK || (rc = checkItem(s, id, token, _index, item)) != LOT_OK)
+		{
+			return fail(s, rc, id, _index);
+		}
+		double v = *value;
+		double old = readValue(*item, token, keyIndex(token, _index));
+		switch (token)
+		{
+		case MonochromatorCurrentWL:
+		case FWheelPositions:
+		case TurretNumGratings:
+		case MonochromatorNumTurrets:
+			return fail(s, LOT_Invalid_Attribute, id, _index);
+		case FWheelCurrentPosition:
+			if (v < 1 || v > readValue(*item, FWheelPositions, 0))
+			{
+				return fail(s, LOT_Invalid_Filter_Pos, id, _index);
+			}
+			if (v != old)
+			{
+				delay(s, latencyFor(s, "filter_change"));
+			}
+			break;
+		case MonochromatorCurrentGrating:
+			if (v < 1 || v > readValue(*item, TurretNumGratings, 0))
+			{
+				return fail(s, LOT_Invalid_Grating, id, _index);
+			}
+			if (v != old)
+			{
+				delay(s, latencyFor(s, "grating_change"));
+			}
+			break;
+		case SAMCurrentState:
+			if (v != 0 && v != 1)
+			{
+				return fail(s, LOT_Invalid_SAM_State, id, _index);
+			}
+			if (v != old)
+			{
+				delay(s, latencyFor(s, "sam_change"));
+			}
+			break;
+		case GratingZord:
+			// as in recalibrate(), the current wavelength moves with the zero order of the current grating
+			if (readValue(*item, MonochromatorCurrentGrating, 0) == _index)
+			{
+				item->values[LOTSystemItem::key_t(MonochromatorCurrentWL, 0)] += (v - old) / 10.0;
+			}
+			break;
+		default:
+			if (LOTSystemModel::is_string_token(token))
+			{
+				return fail(s, LOT_Invalid_Attribute, id, _index);
+			}
+			break;
+		}
+		item->values[LOTSystemItem::key_t(token, keyIndex(token, _index))] = v;
+		return LOT_OK;
+	}
+
+	int LOT_get_str(const char* id, int token, int _index, char* str)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "get_str", id, token);
+		delay(s, tokenLatency(s, "get_str", token));
+		LOTSystemItem* item = NULL;
+		if (rc != LOT_OK || (rc = checkItem(s, id, token, _index, item)) != LOT_OK)
+		{
+			return fail(s, rc, id, _index);
+		}
+		if (!LOTSystemModel::is_string_token(token))
+		{
+			return fail(s, LOT_Invalid_Attribute, id, _index);
+		}
+		std::map<LOTSystemItem::key_t, std::string>::const_iterator it = item->strings.find(LOTSystemItem::key_t(token, keyIndex(token, _index)));
+		return copyOut((it != item->strings.end() ? it->second : (token == lotDescriptor ? item->id : std::string())), str);
+	}
+
+	int LOT_set_str(const char* id, int token, int _index, const char* str)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "set_str", id, token);
+		delay(s, tokenLatency(s, "set_str", token));
+		LOTSystemItem* item = NULL;
+		if (rc != LOT_OK || (rc = checkItem(s, id, token, _index, item)) != LOT_OK)
+		{
+			return fail(s, rc, id, _index);
+		}
+		if (!LOTSystemModel::is_string_token(token))
+		{
+			return fail(s, LOT_Invalid_Attribute, id, _index);
+		}
+		item->strings[LOTSystemItem::key_t(token, keyIndex(token, _index))] = (str != NULL ? str : "");
+		return LOT_OK;
+	}
+
+	int LOT_get_comms_list(char* list)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "query");
+		delay(s, latencyFor(s, "query"));
+		if (rc != LOT_OK || (!s.built && (rc = LOT_System_Not_Initialised)))
+		{
+			return fail(s, rc, NULL);
+		}
+		std::string ids;
+		for (auto it = s.model.comms().cbegin(); it != s.model.comms().cend(); ++it)
+		{
+			ids += it->id + ",";
+		}
+		return copyOut(ids, list);
+	}
+
+	int LOT_get_hardware_list(char* list)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "query");
+		delay(s, latencyFor(s, "query"));
+		if (rc != LOT_OK || (!s.built && (rc = LOT_System_Not_Initialised)))
+		{
+			return fail(s, rc, NULL);
+		}
+		std::string ids;
+		for (auto it = s.model.hardware().cbegin(); it != s.model.hardware().cend(); ++it)
+		{
+			if (it->mono.empty()) // mono items are reported by LOT_get_mono_items
+			{
+				ids += it->id + ",";
+			}
+		}
+		return copyOut(ids, list);
+	}
+
+	int LOT_get_hardware_type(const char* id, int *HardwareType)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "query", id);
+		delay(s, latencyFor(s, "query"));
+		if (rc != LOT_OK || (!s.built && (rc = LOT_System_Not_Initialised)))
+		{
+			return fail(s, rc, id);
+		}
+		const LOTSystemItem* item = (id != NULL ? s.model.find(id) : NULL);
+		if (item == NULL || item->type == LOTSystemItem::Comms)
+		{
+			return fail(s, LOT_Invalid_ID, id);
+		}
+		*HardwareType = item->type;
+		return LOT_OK;
+	}
+
+	int LOT_get_mono_items(const char* monoID, char* ItemIDs)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "query", monoID);
+		delay(s, latencyFor(s, "query"));
+		if (rc != LOT_OK || (!s.built && (rc = LOT_System_Not_Initialised)))
+		{
+			return fail(s, rc, monoID);
+		}
+		const LOTSystemItem* item = (monoID != NULL ? s.model.find(monoID) : NULL);
+		if (item == NULL)
+		{
+			return fail(s, LOT_Invalid_ID, monoID);
+		}
+		if (item->type != lotMono)
+		{
+			return fail(s, LOT_Invalid_Hardware_Type, monoID);
+		}
+		std::list<std::string> items;
+		s.model.mono_items(monoID, items);
+		std::string ids;
+		for (auto it = items.cbegin(); it != items.cend(); ++it)
+		{
+			ids += *it + ",";
+		}
+		return copyOut(ids, ItemIDs);
+	}
+
+	int LOT_get_last_error(int *ErrorCode, char* ID, int *Address)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		*ErrorCode = s.last_error;
+		*Address = s.last_address;
+		return copyOut(s.last_id, ID);
+	}
+
+	int LOT_recalibrate(const char* ID, int _index, double Wavelength, double CorrectWavelength, int *OldZord, int *NewZord)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "recalibrate", ID, GratingZord);
+		delay(s, latencyFor(s, "recalibrate"));
+		LOTSystemItem* item = NULL;
+		if (rc != LOT_OK || (rc = checkItem(s, ID, GratingZord, _index, item)) != LOT_OK)
+		{
+			return fail(s, rc, ID, _index);
+		}
+		// the zero order offset is in motor steps; assume 10 steps per nm
+		*OldZord = static_cast<int>(item->value(GratingZord, _index));
+		*NewZord = *OldZord + static_cast<int>(floor((CorrectWavelength - Wavelength) * 10.0 + 0.5));
+		item->values[LOTSystemItem::key_t(GratingZord, _index)] = *NewZord;
+		if (readValue(*item, MonochromatorCurrentGrating, 0) == _index)
+		{
+			item->values[LOTSystemItem::key_t(MonochromatorCurrentWL, 0)] += (*NewZord - *OldZord) / 10.0;
+		}
+		return LOT_OK;
+	}
+
+	int LOT_save_setup()
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "save_setup");
+		delay(s, latencyFor(s, "save_setup"));
+		if (rc != LOT_OK || (!s.initialised && (rc = LOT_System_Not_Initialised)))
+		{
+			return fail(s, rc, NULL);
+		}
+		return LOT_OK;
+	}
+
+	int LOT_select_wavelength(double wl)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "select_wavelength", NULL, MonochromatorCurrentWL);
+		double t = latencyFor(s, "select_wavelength");
+		if (rc != LOT_OK || (!s.initialised && (rc = LOT_System_Not_Initialised)))
+		{
+			delay(s, t);
+			return fail(s, rc, NULL);
+		}
+		if (wl < 0.0)
+		{
+			delay(s, t);
+			return fail(s, LOT_Invalid_Turret_Wavelength, NULL);
+		}
+		// work out the new state of everything in the current group that moves with wavelength
+		std::vector<std::pair<LOTSystemItem*, std::pair<int, double> > > moves;
+		for (auto it = s.model.hardware().cbegin(); it != s.model.hardware().cend(); ++it)
+		{
+			LOTSystemItem& item = *s.model.find(it->id);
+			if (item.group != s.group || (item.type != lotMono && readValue(item, lotMoveWithWavelength, 0) == 0.0))
+			{
+				continue;
+			}
+			switch (item.type)
+			{
+			case lotMono:
+			{
+				int grating = static_cast<int>(readValue(item, MonochromatorCurrentGrating, 0));
+				if (readValue(item, MonochromatorAutoSelectWavelength, 0) != 0.0)
+				{
+					grating = selectIndex(item, GratingSwitchWL, static_cast<int>(readValue(item, TurretNumGratings, 0)), wl);
+				}
+				if (grating != readValue(item, MonochromatorCurrentGrating, 0))
+				{
+					t += latencyFor(s, "grating_change");
+				}
+				t += fabs(wl - readValue(item, MonochromatorCurrentWL, 0)) * latencyFor(s, "per_nm");
+				moves.push_back(std::make_pair(&item, std::make_pair(MonochromatorCurrentGrating, static_cast<double>(grating))));
+				moves.push_back(std::make_pair(&item, std::make_pair(MonochromatorCurrentWL, wl)));
+				break;
+			}
+			case lotFilterWheel:
+			{
+				int pos = selectIndex(item, FWheelFilter, static_cast<int>(readValue(item, FWheelPositions, 0)), wl);
+				if (pos != readValue(item, FWheelCurrentPosition, 0))
+				{
+					t += latencyFor(s, "filter_change");
+				}
+				moves.push_back(std::make_pair(&item, std::make_pair(FWheelCurrentPosition, static_cast<double>(pos))));
+				break;
+			}
+			case lotSAM:
+			{
+				double initial = readValue(item, SAMInitialState, 0);
+				double state = (item.has(SAMSwitchWL) && wl >= readValue(item, SAMSwitchWL, 0) ? 1.0 - initial : initial);
+				if (state != readValue(item, SAMCurrentState, 0))
+				{
+					t += latencyFor(s, "sam_change");
+				}
+				moves.push_back(std::make_pair(&item, std::make_pair(SAMCurrentState, state)));
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		delay(s, t);
+		for (auto m = moves.cbegin(); m != moves.cend(); ++m)
+		{
+			m->first->values[LOTSystemItem::key_t(m->second.first, 0)] = m->second.second;
+		}
+		return LOT_OK;
+	}
+
+	int LOT_set_c_group(int group)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		int rc = begin(s, "set_c_group");
+		delay(s, latencyFor(s, "set_c_group"));
+		if (rc != LOT_OK || (!s.built && (rc = LOT_System_Not_Initialised)))
+		{
+			return fail(s, rc, NULL);
+		}
+		for (auto it = s.model.comms().cbegin(); it != s.model.comms().cend(); ++it)
+		{
+			if (it->group == group)
+			{
+				s.group = group;
+				return LOT_OK;
+			}
+		}
+		return fail(s, (s.model.comms().size() > 0 ? LOT_Invalid_Group : LOT_No_Groups_Exist), NULL, group);
+	}
+
+	int LOT_version(char* Version)
+	{
+		return copyOut("LOT SDK simulator 1.0", Version);
+	}
+
+	int LOTSim_set_latency(const char* key, double seconds)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		if (key == NULL)
+		{
+			return LOT_Invalid_Value;
+		}
+		s.latency[key] = seconds;
+		s.token_latency.clear();
+		return LOT_OK;
+	}
+
+	int LOTSim_configure_latency(const char* spec)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		return (spec != NULL ? configureLatency(s, spec) : LOT_Invalid_Value);
+	}
+
+	int LOTSim_inject_error(const char* op, const char* id, int token, int errcode, int count)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		ErrorRule e;
+		e.op = (op == NULL || !strcmp(op, "*") ? "" : op);
+		e.id = (id == NULL || !strcmp(id, "*") ? "" : id);
+		e.token = token;
+		e.code = errcode;
+		e.count = count;
+		s.errors.push_back(e);
+		return LOT_OK;
+	}
+
+	int LOTSim_configure_errors(const char* spec)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		return (spec != NULL ? configureErrors(s, spec) : LOT_Invalid_Value);
+	}
+
+	void LOTSim_clear_errors()
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		s.errors.clear();
+	}
+
+	long LOTSim_call_count(const char* op)
+	{
+		SimState& s = sim();
+		std::lock_guard<std::mutex> guard(s.lock);
+		std::map<std::string, long>::const_iterator it = s.calls.find(op != NULL ? op : "*");
+		return (it != s.calls.end() ? it->second : 0);
+	}
+
+}
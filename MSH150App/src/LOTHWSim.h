@@ -0,0 +1,45 @@
+#ifndef LOTHWSIM_H
+#define LOTHWSIM_H
+
+#include "LOTHW.h"
+
+/* Control interface of the simulated LOT SDK (LOTHWSim.cpp), not present in the vendor DLL.
+ *
+ * Latency keys are either an SDK operation name (build_system_model, close, initialise, get, set,
+ * get_str, set_str, select_wavelength, save_setup, recalibrate, set_c_group, query), a token name
+ * (e.g. MonochromatorCurrentWL, overriding get/set latency for that token), one of the move
+ * components grating_change, filter_change, sam_change, per_nm, the IMAC timeout penalty
+ * timeout, or scale (multiplies every latency, 0 disables sleeping).
+ *
+ * The same settings are read from the environment when the system model is built:
+ *   LOTSIM_LATENCY="scale=0.1,select_wavelength=0.2,MonochromatorCurrentWL=0.001"
+ *   LOTSIM_ERRORS="get,mono1,MonochromatorCurrentWL,18,5;select_wavelength,*,*,14,-1"
+ * where each error rule is op,id,token,code[,count] with * as a wildcard and count -1 meaning
+ * forever (default 1).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	LOTHW_API int LOTSim_set_latency(const char* key, double seconds);
+
+	/* comma separated key=seconds list */
+	LOTHW_API int LOTSim_configure_latency(const char* spec);
+
+	/* fail the next count matching calls with errcode; op/id NULL or "*" and token -1 match anything */
+	LOTHW_API int LOTSim_inject_error(const char* op, const char* id, int token, int errcode, int count);
+
+	/* semicolon separated list of op,id,token,code[,count] rules */
+	LOTHW_API int LOTSim_configure_errors(const char* spec);
+
+	LOTHW_API void LOTSim_clear_errors();
+
+	/* number of SDK calls made for operation op ("*" for all) since the model was built */
+	LOTHW_API long LOTSim_call_count(const char* op);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOTHWSIM_H */
@@ -0,0 +1,71 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTHISTORY_H
+#define LOTHISTORY_H
+
+/// Ring buffer of the last capacity() timestamped values of a parameter.
+///
+/// The storage is allocated on construction, so add() never allocates. A value is only recorded when it differs
+/// from the one before, so the buffer holds the changes of a parameter, e.g. each wavelength passed through during
+/// a move, rather than the same reading repeated every poll. Times are seconds since the POSIX epoch.
+class LOTHistory
+{
+public:
+	enum { DefaultSize = 1000 }; ///< samples kept for each parameter, the NELM of its LOT_history.template waveforms
+
+	explicit LOTHistory(size_t capacity = DefaultSize) : m_times(capacity), m_values(capacity), m_next(0), m_size(0), m_seq(0),
+		m_published(0) { }
+
+	/// record \a value read at \a when, unless it is the last value recorded
+	void add(const epicsTimeStamp& when, double value)
+	{
+		if (m_size > 0 && value == m_values[(m_next + capacity() - 1) % capacity()])
+		{
+			return;
+		}
+		m_times[m_next] = static_cast<double>(when.secPastEpoch) + POSIX_TIME_AT_EPICS_EPOCH + 1.0e-9 * when.nsec;
+		m_values[m_next] = value;
+		m_next = (m_next + 1) % capacity();
+		if (m_size < capacity())
+		{
+			++m_size;
+		}
+		++m_seq;
+	}
+
+	/// copy the samples, oldest first, to \a times and \a values, each with room for capacity(); returns how many
+	size_t copy(double* times, double* values) const
+	{
+		size_t first = (m_next + capacity() - m_size) % capacity();
+		for (size_t k = 0; k < m_size; ++k)
+		{
+			size_t i = (first + k) % capacity();
+			times[k] = m_times[i];
+			values[k] = m_values[i];
+		}
+		return m_size;
+	}
+
+	size_t capacity() const { return m_times.size(); }
+	size_t size() const { return m_size; }
+	/// samples recorded since construction, which is the sequence number of the newest; the oldest held is seq() - size() + 1
+	unsigned long seq() const { return m_seq; }
+	/// true if samples have been recorded since the last call to published()
+	bool unpublished() const { return m_seq != m_published; }
+	void published() { m_published = m_seq; }
+
+private:
+	std::vector<double> m_times;
+	std::vector<double> m_values;
+	size_t m_next; ///< where the next sample goes
+	size_t m_size;
+	unsigned long m_seq;
+	unsigned long m_published; ///< m_seq when last published
+};
+
+#endif /* LOTHISTORY_H */
@@ -0,0 +1,180 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+
+#include <errlog.h>
+
+#include <epicsExport.h>
+
+#include "LOTLayout.h"
+
+namespace {
+
+	const char* cache_magic = "LOTLayout 1"; ///< first line of a cache file, change if the format changes
+
+	/// FNV-1a 64 bit hash of \a s, continuing from \a h
+	unsigned long long fnv1a(const std::string& s, unsigned long long h)
+	{
+		for (size_t i = 0; i < s.size(); ++i)
+		{
+			h ^= static_cast<unsigned char>(s[i]);
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+}
+
+void LOTLayout::clear()
+{
+	comms.clear();
+	items.clear();
+	params.clear();
+}
+
+void LOTLayout::addItem(const std::string& id, int type)
+{
+	Item item = { id, type };
+	items.push_back(item);
+}
+
+void LOTLayout::addParam(const std::string& id, int token, int index, bool is_string, bool writable)
+{
+	Param param = { id, token, index, is_string, writable, false, 0.0, "" };
+	params.push_back(param);
+}
+
+/// Hash of the contents of \a config_file and \a key, or an empty string if the file cannot be read
+std::string LOTLayout::hash(const std::string& config_file, const std::string& key)
+{
+	std::ifstream in(config_file.c_str(), std::ios::in | std::ios::binary);
+	if (!in.good())
+	{
+		return "";
+	}
+	std::ostringstream contents;
+	contents << in.rdbuf();
+	char buffer[32];
+	sprintf(buffer, "%016llx", fnv1a(key, fnv1a(contents.str(), 14695981039346656037ULL)));
+	return buffer;
+}
+
+/// Replace the layout with the one cached in \a file; returns false, leaving the layout empty, if there is no
+/// cache or it was saved with a different \a hash.
+///
+/// Each line is a record type followed by its fields, with the id last so it may contain spaces.
+bool LOTLayout::load(const std::string& file, const std::string& hash)
+{
+	clear();
+	std::ifstream in(file.c_str());
+	std::string line, what, id;
+	if (hash.empty() || !std::getline(in, line) || line != cache_magic || !std::getline(in, line) || line != "hash " + hash)
+	{
+		return false;
+	}
+	bool ok = true;
+	while (ok && std::getline(in, line))
+	{
+		std::istringstream iss(line);
+		id.clear();
+		iss >> what;
+		if (what == "comms")
+		{
+			iss >> std::ws;
+			std::getline(iss, id);
+			comms.push_back(id);
+		}
+		else if (what == "item")
+		{
+			int type;
+			iss >> type >> std::ws;
+			std::getline(iss, id);
+			addItem(id, type);
+		}
+		else if (what == "param")
+		{
+			int token, index, is_string, writable;
+			iss >> token >> index >> is_string >> writable >> std::ws;
+			std::getline(iss, id);
+			addParam(id, token, index, is_string != 0, writable != 0);
+		}
+		else if (what == "value" || what == "str")
+		{
+			size_t k = params.size();
+			iss >> k;
+			if (k < params.size() && what == "value")
+			{
+				iss >> params[k].value;
+				params[k].has_value = true;
+			}
+			else if (k < params.size())
+			{
+				params[k].str = line.substr(line.find(' ', 4) + 1); // may be empty or begin with spaces
+				params[k].has_value = true;
+			}
+			ok = (k < params.size() && !iss.fail());
+			continue;
+		}
+		else if (what == "end")
+		{
+			return true;
+		}
+		ok = (ok && !iss.fail() && !id.empty());
+	}
+	errlogSevPrintf(errlogMinor, "LOT: parameter layout cache \"%s\" is incomplete, ignoring it\n", file.c_str());
+	clear();
+	return false;
+}
+
+void LOTLayout::save(const std::string& file, const std::string& hash) const
+{
+	if (hash.empty())
+	{
+		return;
+	}
+	std::string tmp_file = file + ".tmp"; // renamed into place once complete, so an IOC stopped part way leaves no partial cache
+	std::ofstream out(tmp_file.c_str(), std::ios::out | std::ios::trunc);
+	out << cache_magic << "\n" << "hash " << hash << "\n";
+	for (auto c = comms.cbegin(); c != comms.cend(); ++c)
+	{
+		out << "comms " << *c << "\n";
+	}
+	for (auto it = items.cbegin(); it != items.cend(); ++it)
+	{
+		out << "item " << it->type << " " << it->id << "\n";
+	}
+	for (auto p = params.cbegin(); p != params.cend(); ++p)
+	{
+		out << "param " << p->token << " " << p->index << " " << (p->is_string ? 1 : 0) << " " << (p->writable ? 1 : 0) << " " << p->id << "\n";
+	}
+	char buffer[32];
+	for (size_t k = 0; k < params.size(); ++k)
+	{
+		if (params[k].has_value && params[k].is_string)
+		{
+			out << "str " << k << " " << params[k].str << "\n";
+		}
+		else if (params[k].has_value)
+		{
+			sprintf(buffer, "%.17g", params[k].value);
+			out << "value " << k << " " << buffer << "\n";
+		}
+	}
+	out << "end\n";
+	out.close();
+	remove(file.c_str());
+	if (out.fail() || rename(tmp_file.c_str(), file.c_str()) != 0)
+	{
+		errlogSevPrintf(errlogMajor, "LOT: unable to write parameter layout cache \"%s\"\n", file.c_str());
+		remove(tmp_file.c_str());
+	}
+}
@@ -0,0 +1,51 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTLAYOUT_H
+#define LOTLAYOUT_H
+
+/// The hardware tree and parameter table LOTPortDriver discovers from the SDK, saved so an IOC restart with the same
+/// system model can rebuild its parameters without enumerating the hardware again.
+///
+/// The cache is a text file keyed on a hash of the system model XML and the values written into the substitutions file;
+/// any difference and load() fails, so the driver enumerates and saves a new one. The values of the static parameters,
+/// which are fixed by the system model, are kept too so they need not be read again.
+class LOTLayout
+{
+public:
+	/// a hardware item, in enumeration order with the items of a monochromator following it
+	struct Item
+	{
+		std::string id;
+		int type; ///< LOTHWTypes
+	};
+	/// arguments of one LOTPortDriver::addRealParam() or addStringParam() call
+	struct Param
+	{
+		std::string id;
+		int token;
+		int index;
+		bool is_string;
+		bool writable;
+		bool has_value; ///< a LOTParam::PollStatic parameter whose value is cached
+		double value;
+		std::string str;
+	};
+
+	std::vector<std::string> comms;
+	std::vector<Item> items;
+	std::vector<Param> params;
+
+	void clear();
+	void addItem(const std::string& id, int type);
+	void addParam(const std::string& id, int token, int index, bool is_string, bool writable);
+	bool load(const std::string& file, const std::string& hash);
+	void save(const std::string& file, const std::string& hash) const;
+	static std::string hash(const std::string& config_file, const std::string& key);
+};
+
+#endif /* LOTLAYOUT_H */
@@ -0,0 +1,326 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+/// @file LOTMakeSubstitutions.cpp Offline generator of the LOT.substitutions file loaded by st.cmd.
+///
+/// Parses the system model XML with LOTSystemModel rather than asking the SDK, and writes the same
+/// LOT_real.template and LOT_string.template substitutions, in the same order, as LOTConfigure() does, so the
+/// database can be generated at build or deploy time on a machine without the vendor DLL or the hardware.
+///
+/// usage: LOTMakeSubstitutions [-P prefix] [-Q prefix] [-p port] [-g group] [-n] [-w] [-o file.substitutions | -c file.substitutions] system_model.xml
+///   P and Q default to the environment variables of the same name, as for LOTConfigure(); port defaults to L0, and
+///   group, the comms group passed to LOTConfigure() for the port, to 0 for all of them. -n leaves out the records of
+///   each index of an indexed attribute, as the LOTConfigure() option LOTOptionNoIndexedRecords does
+///
+/// Anything in the XML that LOTSystemModel cannot place is reported, and nothing is written unless -w is given, as the
+/// file would be missing records. -c compares the output with a substitutions file LOTConfigure() wrote from the SDK
+/// for the same system model, port, P, Q and options, and fails on the first difference; this is how to check the
+/// parser against a vendor system model file.
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <list>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <epicsTime.h>
+
+#include "asynPortDriver.h"
+
+#include "LOTUtils.h"
+#include "LOTSystemModel.h"
+#include "LOTStats.h"
+#include "LOTHistory.h"
+#include "LOTParam.h"
+
+namespace {
+
+	class SubstitutionsWriter
+	{
+	public:
+		SubstitutionsWriter(const LOTSystemModel& model, std::ostream& os, const std::string& P, const std::string& Q, const std::string& port,
+			int group, bool indexed_records) : m_model(model), m_os(os), m_P(P), m_Q(Q), m_port(port), m_group(group),
+			m_indexed_records(indexed_records), m_count(0) { }
+
+		/// the parameters LOTPortDriver adds for the model, in the order it adds them
+		void write()
+		{
+			for (auto c = m_model.comms().cbegin(); c != m_model.comms().cend(); ++c)
+			{
+				if (m_group == 0 || c->group == m_group)
+				{
+					real(c->id, SimulationMode);
+				}
+			}
+			for (auto h = m_model.hardware().cbegin(); h != m_model.hardware().cend(); ++h)
+			{
+				if (h->mono.empty() && (m_group == 0 || h->group == m_group)) // mono items follow their monochromator, as in the SDK hardware list
+				{
+					item(*h);
+				}
+			}
+			for (auto f = m_families.cbegin(); f != m_families.cend(); ++f) // after all the others, as LOTPortDriver::addFamilies() adds them
+			{
+				LOTParam::writeArraySubstitution(m_os, f->id, f->token, f->n, m_P, m_Q, m_port);
+				++m_count;
+			}
+		}
+
+		int count() const { return m_count; }
+
+	private:
+		const LOTSystemModel& m_model;
+		std::ostream& m_os;
+		std::string m_P;
+		std::string m_Q;
+		std::string m_port;
+		int m_group;
+		bool m_indexed_records;
+		int m_count;
+		struct Family
+		{
+			std::string id;
+			int token;
+			int n;
+		};
+		std::vector<Family> m_families; ///< indexed attributes, in the order their first index was written
+
+		void real(const std::string& id, int token, int index = -1)
+		{
+			if (index != -1)
+			{
+				if (m_families.empty() || m_families.back().id != id || m_families.back().token != token)
+				{
+					Family family = { id, token, 0 };
+					m_families.push_back(family);
+				}
+				++m_families.back().n;
+				if (!m_indexed_records)
+				{
+					return;
+				}
+			}
+			LOTParam::writeSubstitution(m_os, LOTParam::Real, id, token, index, false, m_P, m_Q, m_port);
+			++m_count;
+			if (LOTParam::tokenPollClass(token) == LOTParam::PollFast) // as LOTPortDriver::addRealParam() adds a history
+			{
+				LOTParam::writeHistorySubstitution(m_os, id, token, index, LOTHistory::DefaultSize, m_P, m_Q, m_port);
+				++m_count;
+			}
+		}
+
+		void str(const std::string& id, int token)
+		{
+			LOTParam::writeSubstitution(m_os, LOTParam::String, id, token, -1, false, m_P, m_Q, m_port);
+			++m_count;
+		}
+
+		/// must match LOTPortDriver::addHardwareParams(); counts default as they do in the SDK
+		void item(const LOTSystemItem& it)
+		{
+			int n;
+			std::list<std::string> mono_items;
+			switch (it.type)
+			{
+			case lotFilterWheel:
+				real(it.id, FWheelPositions);
+				n = static_cast<int>(it.value(FWheelPositions, 0, it.max_index(FWheelFilter)));
+				for (int i = 1; i <= n; ++i)
+				{
+					real(it.id, FWheelFilter, i);
+				}
+				real(it.id, FWheelCurrentPosition);
+				real(it.id, lotMoveWithWavelength);
+				str(it.id, lotDescriptor);
+				break;
+			case lotMono:
+				real(it.id, MonochromatorCurrentWL);
+				real(it.id, MonochromatorCurrentGrating);
+				real(it.id, MonochromatorModeSwitchNum);
+				real(it.id, MonochromatorModeSwitchState);
+				real(it.id, MonochromatorCanModeSwitch);
+				real(it.id, MonochromatorAutoSelectWavelength);
+				real(it.id, MonochromatorNumTurrets);
+				real(it.id, TurretNumGratings);
+				n = static_cast<int>(it.value(TurretNumGratings, 0, std::max(it.max_index(GratingSwitchWL), 1)));
+				for (int i = 1; i <= n; ++i)
+				{
+					real(it.id, GratingSwitchWL, i);
+				}
+				str(it.id, lotDescriptor);
+				m_model.mono_items(it.id, mono_items);
+				for (auto m = mono_items.cbegin(); m != mono_items.cend(); ++m)
+				{
+					const LOTSystemItem* mi = m_model.find(*m);
+					if (mi != NULL)
+					{
+						item(*mi);
+					}
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	};
+
+	std::string envOr(const char* name, const char* def)
+	{
+		const char* value = getenv(name);
+		return (value != NULL ? value : def);
+	}
+
+	void usage()
+	{
+		std::cerr << "usage: LOTMakeSubstitutions [-P prefix] [-Q prefix] [-p port] [-g group] [-n] [-w] [-o file.substitutions | -c file.substitutions] system_model.xml" << std::endl;
+	}
+
+	/// compare \a generated with the contents of \a file line by line; returns true if they are the same
+	bool compare(const std::string& generated, const char* file)
+	{
+		std::ifstream in(file);
+		if (!in.good())
+		{
+			throw std::runtime_error(std::string("cannot open ") + file);
+		}
+		std::istringstream gen(generated);
+		std::string expected, actual;
+		for (int n = 1; ; ++n)
+		{
+			bool more_expected = static_cast<bool>(std::getline(in, expected));
+			bool more_actual = static_cast<bool>(std::getline(gen, actual));
+			if (!more_expected && !more_actual)
+			{
+				return true;
+			}
+			if (more_expected != more_actual || expected != actual)
+			{
+				std::cerr << "LOTMakeSubstitutions: differs from " << file << " at line " << n << "\n  driver:    " <<
+					(more_expected ? expected : "<end of file>") << "\n  generated: " << (more_actual ? actual : "<end of file>") << std::endl;
+				return false;
+			}
+		}
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	std::string P = envOr("P", ""), Q = envOr("Q", ""), port = "L0";
+	int group = 0;
+	bool indexed_records = true;
+	bool allow_warnings = false;
+	const char* config_file = NULL;
+	const char* subst_file = NULL;
+	const char* compare_file = NULL;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-P") && i + 1 < argc)
+		{
+			P = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-Q") && i + 1 < argc)
+		{
+			Q = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+		{
+			port = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+		{
+			group = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-n"))
+		{
+			indexed_records = false;
+		}
+		else if (!strcmp(argv[i], "-w"))
+		{
+			allow_warnings = true;
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			subst_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+		{
+			compare_file = argv[++i];
+		}
+		else if (argv[i][0] != '-' && config_file == NULL)
+		{
+			config_file = argv[i];
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (config_file == NULL || (subst_file != NULL && compare_file != NULL))
+	{
+		usage();
+		return 1;
+	}
+	try
+	{
+		LOTParam::setupMappings();
+		LOTSystemModel model;
+		model.load(config_file);
+		for (auto w = model.warnings().cbegin(); w != model.warnings().cend(); ++w)
+		{
+			std::cerr << "LOTMakeSubstitutions: " << config_file << ": " << *w << std::endl;
+		}
+		if (!model.warnings().empty() && !allow_warnings)
+		{
+			std::cerr << "LOTMakeSubstitutions: " << model.warnings().size() << " problems reading " << config_file <<
+				", the substitutions would be incomplete; use -w to write them anyway" << std::endl;
+			return 1;
+		}
+		std::ostringstream oss;
+		SubstitutionsWriter writer(model, oss, P, Q, port, group, indexed_records);
+		writer.write();
+		if (compare_file != NULL)
+		{
+			if (!compare(oss.str(), compare_file))
+			{
+				return 2;
+			}
+			std::cerr << "LOTMakeSubstitutions: " << writer.count() << " parameters match " << compare_file << std::endl;
+		}
+		else if (subst_file != NULL)
+		{
+			std::ofstream out(subst_file, std::ios::out | std::ios::trunc);
+			out << oss.str();
+			out.close();
+			if (out.fail())
+			{
+				std::cerr << "LOTMakeSubstitutions: cannot write " << subst_file << std::endl;
+				return 1;
+			}
+			std::cerr << "LOTMakeSubstitutions: " << writer.count() << " parameters written to " << subst_file << std::endl;
+		}
+		else
+		{
+			std::cout << oss.str();
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "LOTMakeSubstitutions: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <list>
+#include <stdexcept>
+#include <map>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+
+#include "asynPortDriver.h"
+
+#include <epicsExport.h>
+
+#include "LOTUtils.h"
+#include "LOTStats.h"
+#include "LOTHistory.h"
+#include "LOTParam.h"
+#include "LOTSdkQueue.h"
+#include "LOTTransitionModel.h"
+#include "LOTCalibration.h"
+#include "LOTLayout.h"
+#include "LOTPortDriver.h"
+#include "LOTMovePort.h"
+
+static const char *driverName = "LOTMovePort"; ///< Name of driver for use in message printing 
+
+LOTMovePort::LOTMovePort(const char *portName, LOTPortDriver* driver)
+	: asynPortDriver(portName,
+		0, /* maxAddr */
+		asynFloat64Mask | asynDrvUserMask, /* Interface mask */
+		asynFloat64Mask,  /* Interrupt mask */
+		ASYN_CANBLOCK, /* asynFlags.  Writes block until the move completes */
+		1, /* Autoconnect */
+		0, /* Default priority */
+		0),	/* Default stack size*/
+		m_driver(driver)
+{
+	createParam(P_selectWavelengthString, asynParamFloat64, &P_selectWavelength);
+}
+
+asynStatus LOTMovePort::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+	static const char* functionName = "writeFloat64";
+	int function = pasynUser->reason;
+	if (function != P_selectWavelength)
+	{
+		return asynPortDriver::writeFloat64(pasynUser, value);
+	}
+	std::string error;
+	m_driver->lock(); // startMove() updates the main port's parameters, but waitMove() must not hold its lock
+	unsigned move = m_driver->startMove(value);
+	m_driver->unlock();
+	if (!m_driver->waitMove(move, error))
+	{
+		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+			"%s:%s: function=%d, name=%s, value=%f, error=%s",
+			driverName, functionName, function, P_selectWavelengthString, value, error.c_str());
+		return asynError;
+	}
+	asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+		"%s:%s: function=%d, name=%s, value=%f\n",
+		driverName, functionName, function, P_selectWavelengthString, value);
+	return asynPortDriver::writeFloat64(pasynUser, value);
+}
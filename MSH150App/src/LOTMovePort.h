@@ -0,0 +1,29 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTMOVEPORT_H
+#define LOTMOVEPORT_H
+
+class LOTPortDriver;
+
+/// Companion asyn port, named after the LOTPortDriver port with a _MOVE suffix, for wavelength moves.
+///
+/// A write to SELECTWAVELENGTH starts the move on the LOTPortDriver move thread and then waits for it to
+/// finish, so a put-callback on the record completes only when the move has. Waiting here rather than on
+/// the main port leaves that free to serve reads and writes while the move is in progress.
+class LOTMovePort : public asynPortDriver
+{
+public:
+	LOTMovePort(const char *portName, LOTPortDriver* driver);
+	virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+
+private:
+	LOTPortDriver* m_driver;
+	int P_selectWavelength; // double
+};
+
+#endif /* LOTMOVEPORT_H */
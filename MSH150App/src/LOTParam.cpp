@@ -0,0 +1,179 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <ostream>
+#include <list>
+#include <map>
+#include <string>
+#include <stdexcept>
+
+#include <boost/algorithm/string.hpp>
+
+#include <epicsTime.h>
+
+#include "asynPortDriver.h"
+
+#include <epicsExport.h>
+
+#include "LOTUtils.h"
+#include "LOTStats.h"
+#include "LOTParam.h"
+
+static std::map<int, std::string> TokenToName;
+static std::map<int, std::string> TokenToDBName;
+static std::map<int, LOTParam::PollClass> TokenToPollClass;
+
+static void addMapping(int token, const std::string& name, const std::string& db_name = "", LOTParam::PollClass poll = LOTParam::PollSlow)
+{
+	TokenToName[token] = name;
+	TokenToDBName[token] = (db_name.size() > 0 ? db_name : name);
+	TokenToPollClass[token] = poll;
+}
+
+/// Tokens are polled according to how often they can change: PollStatic values are fixed by the
+/// system model and read once, PollFast ones follow a move and everything else is PollSlow.
+void LOTParam::setupMappings()
+{
+	addMapping(MonochromatorScanDirection, "MonochromatorScanDirection", "SCANDIR");
+	addMapping(MonochromatorCurrentWL, "MonochromatorCurrentWL", "WL", PollFast);
+
+	addMapping(MonochromatorCurrentGrating, "MonochromatorCurrentGrating", "GRATING", PollFast);
+	addMapping(MonochromatorInitialise, "MonochromatorInitialise");
+	addMapping(MonochromatorModeSwitchNum, "MonochromatorModeSwitchNum", "MODE:SWNUM"); // for double single mode switching
+	addMapping(MonochromatorModeSwitchState, "MonochromatorModeSwitchState", "MODE:SWSTATE", PollFast); // state of SAM for above
+	addMapping(MonochromatorCanModeSwitch, "MonochromatorCanModeSwitch", "MODE:CANSWITCH");
+	addMapping(MonochromatorAutoSelectWavelength, "MonochromatorAutoSelectWavelength", "AUTOWL"); // auto select grating
+	addMapping(MonochromatorZordSwitchSAM, "MonochromatorZordSwitchSAM");
+	addMapping(MonochromatorNumTurrets, "MonochromatorNumTurrets", "NUMTURRETS", PollStatic);
+	addMapping(MonochromatorCosAlpha, "MonochromatorCosAlpha", "", PollStatic);
+
+	addMapping(TurretNumGratings, "TurretNumGratings", "TURNUMGRAT", PollStatic);
+
+	addMapping(GratingDensity, "GratingDensity", "", PollStatic);
+	addMapping(GratingZord, "GratingZord");
+	addMapping(GratingAlpha, "GratingAlpha", "", PollStatic);
+	addMapping(GratingSwitchWL, "GratingSwitchWL", "GRATSWTWL", PollStatic);
+	addMapping(GratingBlaze, "GratingBlaze", "", PollStatic);
+
+	//-----------------------------------------------------------------------------
+	// Filter wheel attributes
+	//-----------------------------------------------------------------------------
+	addMapping(FWheelFilter, "FWheelFilter", "FILTER", PollStatic);
+	addMapping(FWheelPositions, "FWheelPositions", "NUMPOS", PollStatic);
+	addMapping(FWheelCurrentPosition, "FWheelCurrentPosition", "POS", PollFast);
+
+	//-----------------------------------------------------------------------------
+	// SAM attributes
+	//-----------------------------------------------------------------------------
+	addMapping(SAMInitialState, "SAMInitialState", "", PollStatic);
+	addMapping(SAMSwitchWL, "SAMSwitchWL", "", PollStatic);
+	addMapping(SAMState, "SAMState");
+	addMapping(SAMCurrentState, "SAMCurrentState", "", PollFast);
+	addMapping(SAMDeflectName, "SAMDeflectName", "", PollStatic);
+	addMapping(SAMNoDeflectName, "SAMNoDeflectName", "", PollStatic);
+
+	//-----------------------------------------------------------------------------
+	// MVSS attributes
+	//-----------------------------------------------------------------------------
+	addMapping(MVSSSwitchWL, "MVSSSwitchWL", "", PollStatic);
+	addMapping(MVSSWidth, "MVSSWidth");
+	addMapping(MVSSCurrentWidth, "MVSSCurrentWidth", "", PollFast);
+	addMapping(MVSSConstantBandwidth, "MVSSConstantBandwidth");
+	addMapping(MVSSConstantwidth, "MVSSConstantwidth");
+	addMapping(MVSSSlitMode, "MVSSSlitMode");
+	addMapping(MVSSPosition, "MVSSPosition");
+	addMapping(MVSSCurrentBandwidth, "MVSSCurrentBandwidth", "", PollFast);
+
+	//-----------------------------------------------------------------------------
+	// Comms Attributes
+	//-----------------------------------------------------------------------------
+	addMapping(SimulationMode, "SimulationMode", "SIM", PollStatic);
+
+	//-----------------------------------------------------------------------------
+	// Miscellaneous attributes
+	//-----------------------------------------------------------------------------
+	addMapping(lotSettleDelay, "lotSettleDelay");
+	addMapping(lotMoveWithWavelength, "lotMoveWithWavelength", "MWWL");
+	addMapping(lotDescriptor, "lotDescriptor", "DESCR", PollStatic);
+	addMapping(lotParkOffset, "lotParkOffset");
+	addMapping(lotProductName, "lotProductName", "", PollStatic);
+}
+
+const std::string& LOTParam::tokenName(int token)
+{
+	static const std::string empty;
+	std::map<int, std::string>::const_iterator it = TokenToName.find(token);
+	return (it != TokenToName.end() ? it->second : empty);
+}
+
+const std::string& LOTParam::tokenDBName(int token)
+{
+	static const std::string empty;
+	std::map<int, std::string>::const_iterator it = TokenToDBName.find(token);
+	return (it != TokenToDBName.end() ? it->second : empty);
+}
+
+LOTParam::PollClass LOTParam::tokenPollClass(int token)
+{
+	std::map<int, PollClass>::const_iterator it = TokenToPollClass.find(token);
+	return (it != TokenToPollClass.end() ? it->second : PollSlow);
+}
+
+/// asyn parameter name for SDK attribute (\a lot_id, \a token, \a index), \a index -1 if it is not indexed
+std::string LOTParam::paramName(const std::string& lot_id, int token, int index)
+{
+	std::string name = lot_id + "_" + tokenName(token);
+	if (index != -1)
+	{
+		char ind_str[16];
+		sprintf(ind_str, "_%d", index);
+		name += ind_str;
+	}
+	return name;
+}
+
+/// Write the LOT_real.template or LOT_string.template substitutions for a parameter to \a os, as loaded by st.cmd.
+/// Used by the driver as it adds parameters and by the offline LOTMakeSubstitutions tool, so the two stay the same.
+void LOTParam::writeSubstitution(std::ostream& os, ParamType type, const std::string& lot_id, int token, int index, bool writable,
+	const std::string& P, const std::string& Q, const std::string& port)
+{
+	char ind_str[10];
+	sprintf(ind_str, "%d", index);
+	os << "file \"${MSH150}/db/" << (type == String ? "LOT_string.template" : "LOT_real.template") << "\" {\n";
+	os << "    { P=\"" << P << "\",Q=\"" << Q << "\",R=\"" << boost::to_upper_copy<std::string>(lot_id) << ":" << tokenDBName(token) << (index != -1 ? ind_str : "") <<
+		"\",PORT=\"" << port << "\"" << ",PARAM=\"" << paramName(lot_id, token, index) << "\",DESC=\"" << tokenName(token).substr(0, 39) <<
+		"\",SET=\"" << (writable ? "" : "#") << "\" }\n";
+	os << "}\n\n";
+}
+
+/// Write the LOT_realArray.template substitutions for the \a nelm indices of (\a lot_id, \a token) published as one
+/// array parameter, named as paramName() with no index
+void LOTParam::writeArraySubstitution(std::ostream& os, const std::string& lot_id, int token, int nelm,
+	const std::string& P, const std::string& Q, const std::string& port)
+{
+	os << "file \"${MSH150}/db/LOT_realArray.template\" {\n";
+	os << "    { P=\"" << P << "\",Q=\"" << Q << "\",R=\"" << boost::to_upper_copy<std::string>(lot_id) << ":" << tokenDBName(token) <<
+		"\",PORT=\"" << port << "\"" << ",PARAM=\"" << paramName(lot_id, token, -1) << "\",NELM=\"" << nelm << "\",DESC=\"" <<
+		tokenName(token).substr(0, 39) << "\" }\n";
+	os << "}\n\n";
+}
+
+/// Write the LOT_history.template substitutions for the last \a nelm changes of a parameter, kept by its LOTHistory
+void LOTParam::writeHistorySubstitution(std::ostream& os, const std::string& lot_id, int token, int index, int nelm,
+	const std::string& P, const std::string& Q, const std::string& port)
+{
+	char ind_str[10];
+	sprintf(ind_str, "%d", index);
+	os << "file \"${MSH150}/db/LOT_history.template\" {\n";
+	os << "    { P=\"" << P << "\",Q=\"" << Q << "\",R=\"" << boost::to_upper_copy<std::string>(lot_id) << ":" << tokenDBName(token) << (index != -1 ? ind_str : "") <<
+		"\",PORT=\"" << port << "\"" << ",PARAM=\"" << paramName(lot_id, token, index) << "\",NELM=\"" << nelm << "\",DESC=\"" <<
+		tokenName(token).substr(0, 39) << "\" }\n";
+	os << "}\n\n";
+}
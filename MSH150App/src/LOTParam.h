@@ -0,0 +1,275 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTPARAM_H
+#define LOTPARAM_H
+
+/// A value read from the SDK by LOTParam::fetch(), staged until it is published by LOTParam::publish()
+struct LOTReading
+{
+	double value;
+	char str[LOT_BUFFER_SIZE]; ///< a fixed buffer, as the SDK fills, so reading a string does not allocate
+	LOTError error; ///< LOT_OK if the read succeeded
+	double seconds; ///< how long the SDK call took
+	LOTReading() : value(0.0), seconds(0.0) { str[0] = '\0'; }
+	void setStr(const char* s) { strncpy(str, s, sizeof(str) - 1); str[sizeof(str) - 1] = '\0'; }
+};
+
+/// A LOT SDK attribute (id, token, index) mirrored in an asyn parameter of the port driver.
+///
+/// Numeric and string attributes share this one class, distinguished by type(), so the driver can keep
+/// its parameters by value in a contiguous table. The attribute is resolved into a LOTHandle when the
+/// parameter is created, and string values are kept in fixed buffers, so polling a parameter once it
+/// has been read the first time makes no heap allocation.
+class LOTParam
+{
+public:
+	enum PollClass { PollStatic, PollSlow, PollFast };
+	enum ParamType { Real, String };
+private:
+	LOTHandle m_handle; // SDK attribute (id, token, index)
+	ParamType m_type;
+	asynPortDriver* m_driver;
+	int m_asyn_id; // asyn parameter id
+	std::string m_asyn_name;
+	PollClass m_poll_class;
+	bool m_has_value; // set once a read has succeeded
+	double m_abs_deadband;
+	double m_rel_deadband;
+	double m_last_value; // last value published to the parameter library, for Real
+	char m_last_str[LOT_BUFFER_SIZE]; // last value published to the parameter library, for String
+	epicsTimeStamp m_read_time; // time of the last read attempt
+	bool m_read_ok; // whether the last read attempt succeeded
+	LOTError m_read_error; // error from the last read attempt if it failed
+	LOTLatencyStats m_read_stats; // SDK reads, by read() or fetch() once their outcome is recorded with readDone()
+	LOTLatencyStats m_write_stats; // SDK writes, by write() or merged in from a LOTWriteRequest
+	int m_failures; // consecutive failed reads, not counting those that lost the whole connection
+	bool m_tripped; // circuit breaker open after too many consecutive failures: only read again at m_retry_time
+	epicsTimeStamp m_retry_time;
+	unsigned long m_trips; // times the breaker has opened
+
+	bool withinDeadband(double d) const
+	{
+		double diff = fabs(d - m_last_value);
+		return (diff == 0.0 || diff <= m_abs_deadband || diff <= m_rel_deadband * fabs(m_last_value));
+	}
+	bool publishReal(double d)
+	{
+		if (m_has_value && withinDeadband(d))
+		{
+			return false;
+		}
+		m_driver->setDoubleParam(m_asyn_id, d);
+		m_last_value = d;
+		m_has_value = true;
+		return true;
+	}
+	bool publishString(const char* s)
+	{
+		if (m_has_value && !strcmp(s, m_last_str))
+		{
+			return false;
+		}
+		m_driver->setStringParam(m_asyn_id, s);
+		setLastStr(s);
+		m_has_value = true;
+		return true;
+	}
+	void setLastStr(const char* s)
+	{
+		strncpy(m_last_str, s, sizeof(m_last_str) - 1);
+		m_last_str[sizeof(m_last_str) - 1] = '\0';
+	}
+public:
+	/// read the SDK value and publish it to the parameter library; returns false if it was not
+	/// published because it is unchanged, or within the deadband of the last published value
+	bool read()
+	{
+		LOTReading reading;
+		fetch(reading);
+		m_read_stats.add(reading.seconds, reading.error.ok());
+		if (!reading.error.ok())
+		{
+			throw LOTException(reading.error.message(), reading.error.code, (reading.error.id != NULL ? reading.error.id : ""), reading.error.address);
+		}
+		return publish(reading);
+	}
+	/// read the SDK value into \a reading, with any error in reading.error rather than thrown, so a failing
+	/// read costs no allocation; uses only the SDK and the attribute (id, token, index), so needs the SDK but not the port lock
+	void fetch(LOTReading& reading) const
+	{
+		epicsTimeStamp start, end;
+		epicsTimeGetCurrent(&start);
+		if (m_type == String)
+		{
+			LOTUtils::try_get_str(m_handle, reading.str, reading.error);
+		}
+		else
+		{
+			LOTUtils::try_get(m_handle, reading.value, reading.error);
+		}
+		epicsTimeGetCurrent(&end);
+		reading.seconds = epicsTimeDiffInSeconds(&end, &start);
+	}
+	/// publish a reading made by fetch(), as read() does; called with the port locked
+	bool publish(const LOTReading& reading)
+	{
+		return (m_type == String ? publishString(reading.str) : publishReal(reading.value));
+	}
+	/// write the value in the parameter library to the SDK, which then becomes the last published value
+	void write()
+	{
+		LOTReading value;
+		if (m_type == String)
+		{
+			m_driver->getStringParam(m_asyn_id, sizeof(value.str), value.str);
+		}
+		else
+		{
+			m_driver->getDoubleParam(m_asyn_id, &value.value);
+		}
+		epicsTimeStamp start, end;
+		epicsTimeGetCurrent(&start);
+		try
+		{
+			put(value);
+		}
+		catch (const std::exception&)
+		{
+			epicsTimeGetCurrent(&end);
+			m_write_stats.add(epicsTimeDiffInSeconds(&end, &start), false);
+			throw;
+		}
+		epicsTimeGetCurrent(&end);
+		m_write_stats.add(epicsTimeDiffInSeconds(&end, &start));
+		setLastValue(value);
+	}
+	/// write \a value to the SDK; like fetch(), needs the SDK but not the port lock
+	void put(const LOTReading& value) const
+	{
+		if (m_type == String)
+		{
+			LOTUtils::set_str(m_handle, value.str);
+		}
+		else
+		{
+			LOTUtils::set(m_handle, value.value);
+		}
+	}
+	/// make \a value, a setpoint now in the parameter library, the one later readings are compared with
+	void setLastValue(const LOTReading& value)
+	{
+		if (m_type == String)
+		{
+			setLastStr(value.str);
+		}
+		else
+		{
+			m_last_value = value.value;
+		}
+	}
+	int id() const { return m_asyn_id; }
+	int token() const { return m_handle.token; }
+	int index() const { return m_handle.index; }
+	const char* lotId() const { return m_handle.id; }
+	const LOTHandle& handle() const { return m_handle; }
+	ParamType type() const { return m_type; }
+	const std::string& name() const { return m_asyn_name; }
+	PollClass pollClass() const { return m_poll_class; }
+	bool hasValue() const { return m_has_value; }
+	/// a new reading is published only if it differs from the last published one by more than
+	/// \a abs_deadband or by more than \a rel_deadband times its magnitude; numeric parameters only
+	void setDeadband(double abs_deadband, double rel_deadband) { m_abs_deadband = abs_deadband; m_rel_deadband = rel_deadband; }
+	double absDeadband() const { return m_abs_deadband; }
+	double relDeadband() const { return m_rel_deadband; }
+	/// record the time and outcome of a read attempt
+	void setReadStatus(const epicsTimeStamp& when, const LOTError& error)
+	{
+		m_read_time = when;
+		m_read_ok = error.ok();
+		m_read_error = error;
+	}
+	/// record a read made by fetch() at \a when, in the read status and the read statistics; called with the port locked
+	void readDone(const epicsTimeStamp& when, const LOTReading& reading)
+	{
+		m_read_stats.add(reading.seconds, reading.error.ok());
+		setReadStatus(when, reading.error);
+	}
+	/// count the outcome of a read in the circuit breaker: it opens after \a max_failures consecutive failures, 0 for never,
+	/// and then lets one read through every \a retry_period seconds until one succeeds. An error that loses the whole
+	/// connection is not the parameter's fault and is not counted. Returns true if the breaker opened or closed.
+	bool updateBreaker(const epicsTimeStamp& when, const LOTError& error, int max_failures, double retry_period)
+	{
+		bool was_tripped = m_tripped;
+		if (error.ok())
+		{
+			m_failures = 0;
+			m_tripped = false;
+			return was_tripped;
+		}
+		if (LOTUtils::comms_lost(error.code) || max_failures <= 0 || ++m_failures < max_failures)
+		{
+			return false;
+		}
+		m_retry_time = when;
+		epicsTimeAddSeconds(&m_retry_time, retry_period);
+		m_tripped = true;
+		if (!was_tripped)
+		{
+			++m_trips;
+		}
+		return !was_tripped;
+	}
+	/// whether the breaker is open and not yet due a retry at \a now, so the parameter should not be read
+	bool breakerHolds(const epicsTimeStamp& now) const { return m_tripped && epicsTimeDiffInSeconds(&m_retry_time, &now) > 0.0; }
+	bool tripped() const { return m_tripped; }
+	int failures() const { return m_failures; }
+	unsigned long trips() const { return m_trips; }
+	/// seconds from \a now until a tripped breaker next lets a read through
+	double retryIn(const epicsTimeStamp& now) const { return (m_tripped ? epicsTimeDiffInSeconds(&m_retry_time, &now) : 0.0); }
+	/// add writes made on the SDK thread by a LOTWriteRequest to the write statistics; called with the port locked
+	void addWriteStats(const LOTLatencyStats& stats) { m_write_stats.merge(stats); }
+	const LOTLatencyStats& readStats() const { return m_read_stats; }
+	const LOTLatencyStats& writeStats() const { return m_write_stats; }
+	void resetStats()
+	{
+		m_read_stats.reset();
+		m_write_stats.reset();
+	}
+	/// seconds since the last read attempt, or -1.0 if there has not been one
+	double readAge(const epicsTimeStamp& now) const { return (m_read_time.secPastEpoch == 0 && m_read_time.nsec == 0 ? -1.0 : epicsTimeDiffInSeconds(&now, &m_read_time)); }
+	bool readOK() const { return m_read_ok; }
+	std::string readError() const { return m_read_error.message(); }
+	static void setupMappings();
+	static const std::string& tokenName(int token);   ///< SDK name of \a token
+	static const std::string& tokenDBName(int token); ///< record name suffix used for \a token
+	static PollClass tokenPollClass(int token);
+	static std::string paramName(const std::string& lot_id, int token, int index);
+	static void writeSubstitution(std::ostream& os, ParamType type, const std::string& lot_id, int token, int index, bool writable,
+		const std::string& P, const std::string& Q, const std::string& port);
+	static void writeArraySubstitution(std::ostream& os, const std::string& lot_id, int token, int nelm,
+		const std::string& P, const std::string& Q, const std::string& port);
+	static void writeHistorySubstitution(std::ostream& os, const std::string& lot_id, int token, int index, int nelm,
+		const std::string& P, const std::string& Q, const std::string& port);
+	/// create the asyn parameter, asynParamFloat64 for \a type Real or asynParamOctet for String
+	LOTParam(const std::string& lot_id, int token, int index, ParamType type, asynPortDriver* driver) :
+		m_type(type), m_driver(driver), m_asyn_id(-1), m_asyn_name(""),
+		m_poll_class(tokenPollClass(token)), m_has_value(false), m_abs_deadband(0.0), m_rel_deadband(0.0), m_last_value(0.0),
+		m_read_ok(false), m_failures(0), m_tripped(false), m_trips(0)
+	{
+		m_handle.id = LOTUtils::intern(lot_id);
+		m_handle.token = token;
+		m_handle.index = index;
+		m_last_str[0] = '\0';
+		m_read_time.secPastEpoch = m_read_time.nsec = 0;
+		m_retry_time = m_read_time;
+		m_asyn_name = paramName(lot_id, token, index);
+		m_driver->createParam(m_asyn_name.c_str(), (type == String ? asynParamOctet : asynParamFloat64), &m_asyn_id);
+	}
+};
+
+#endif /* LOTPARAM_H */
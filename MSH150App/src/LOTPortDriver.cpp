@@ -11,14 +11,16 @@
 #include <errno.h>
 #include <math.h>
 #include <exception>
+#include <stdexcept>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <list>
 #include <map>
+#include <vector>
+#include <memory>
 #include <string>
-
-#include <boost/algorithm/string.hpp>
+#include <functional>
 
 #include <shareLib.h>
 #include <epicsTypes.h>
@@ -28,8 +30,10 @@
 #include <epicsString.h>
 #include <epicsTimer.h>
 #include <epicsMutex.h>
+#include <epicsGuard.h>
 #include <epicsEvent.h>
 #include <errlog.h>
+#include <alarm.h>
 #include <iocsh.h>
 #include <macLib.h>
 
@@ -42,154 +46,28 @@
 #include <epicsExport.h>
 
 #include "LOTUtils.h"
+#include "LOTSystemModel.h"
+#include "LOTStats.h"
+#include "LOTHistory.h"
+#include "LOTParam.h"
+#include "LOTSdkQueue.h"
+#include "LOTSdkArbiter.h"
+#include "LOTTransitionModel.h"
+#include "LOTCalibration.h"
+#include "LOTLayout.h"
 #include "LOTPortDriver.h"
+#include "LOTMovePort.h"
 
 static const char *driverName = "LOTPortDriver"; ///< Name of driver for use in message printing 
 
-static std::map<int, std::string> TokenToName;
-static std::map<int, std::string> TokenToDBName;
-
-static void addMapping(int token, const std::string& name, const std::string& db_name = "")
-{
-	TokenToName[token] = name;
-	TokenToDBName[token] = (db_name.size() > 0 ? db_name : name);
-}
-
-static void setupMappings()
-{
-	addMapping(MonochromatorScanDirection, "MonochromatorScanDirection", "SCANDIR");
-	addMapping(MonochromatorCurrentWL, "MonochromatorCurrentWL", "WL");
-
-	addMapping(MonochromatorCurrentGrating, "MonochromatorCurrentGrating", "GRATING");
-	addMapping(MonochromatorInitialise, "MonochromatorInitialise");
-	addMapping(MonochromatorModeSwitchNum, "MonochromatorModeSwitchNum", "MODE:SWNUM"); // for double single mode switching
-	addMapping(MonochromatorModeSwitchState, "MonochromatorModeSwitchState", "MODE:SWSTATE"); // state of SAM for above
-	addMapping(MonochromatorCanModeSwitch, "MonochromatorCanModeSwitch", "MODE:CANSWITCH");
-	addMapping(MonochromatorAutoSelectWavelength, "MonochromatorAutoSelectWavelength", "AUTOWL"); // auto select grating
-	addMapping(MonochromatorZordSwitchSAM, "MonochromatorZordSwitchSAM");
-	addMapping(MonochromatorNumTurrets, "MonochromatorNumTurrets", "NUMTURRETS");
-	addMapping(MonochromatorCosAlpha, "MonochromatorCosAlpha");
-
-	addMapping(TurretNumGratings, "TurretNumGratings", "TURNUMGRAT");
-
-	addMapping(GratingDensity, "GratingDensity");
-	addMapping(GratingZord, "GratingZord");
-	addMapping(GratingAlpha, "GratingAlpha");
-	addMapping(GratingSwitchWL, "GratingSwitchWL", "GRATSWTWL");
-	addMapping(GratingBlaze, "GratingBlaze");
-
-	//-----------------------------------------------------------------------------
-	// Filter wheel attributes
-	//-----------------------------------------------------------------------------
-	addMapping(FWheelFilter, "FWheelFilter", "FILTER");
-	addMapping(FWheelPositions, "FWheelPositions", "NUMPOS");
-	addMapping(FWheelCurrentPosition, "FWheelCurrentPosition", "POS");
-
-	//-----------------------------------------------------------------------------
-	// SAM attributes
-	//-----------------------------------------------------------------------------
-	addMapping(SAMInitialState, "SAMInitialState");
-	addMapping(SAMSwitchWL, "SAMSwitchWL");
-	addMapping(SAMState, "SAMState");
-	addMapping(SAMCurrentState, "SAMCurrentState");
-	addMapping(SAMDeflectName, "SAMDeflectName");
-	addMapping(SAMNoDeflectName, "SAMNoDeflectName");
-
-	//-----------------------------------------------------------------------------
-	// MVSS attributes
-	//-----------------------------------------------------------------------------
-	addMapping(MVSSSwitchWL, "MVSSSwitchWL");
-	addMapping(MVSSWidth, "MVSSWidth");
-	addMapping(MVSSCurrentWidth, "MVSSCurrentWidth");
-	addMapping(MVSSConstantBandwidth, "MVSSConstantBandwidth");
-	addMapping(MVSSConstantwidth, "MVSSConstantwidth");
-	addMapping(MVSSSlitMode, "MVSSSlitMode");
-	addMapping(MVSSPosition, "MVSSPosition");
-	addMapping(MVSSCurrentBandwidth, "MVSSCurrentBandwidth");
-
-	//-----------------------------------------------------------------------------
-	// Comms Attributes
-	//-----------------------------------------------------------------------------
-	addMapping(SimulationMode, "SimulationMode", "SIM");
-
-	//-----------------------------------------------------------------------------
-	// Miscellaneous attributes
-	//-----------------------------------------------------------------------------
-	addMapping(lotSettleDelay, "lotSettleDelay");
-	addMapping(lotMoveWithWavelength, "lotMoveWithWavelength", "MWWL");
-	addMapping(lotDescriptor, "lotDescriptor", "DESCR");
-	addMapping(lotParkOffset, "lotParkOffset");
-	addMapping(lotProductName, "lotProductName");
-}
-
-class LOTParam
-{
-protected:
-	std::string m_lot_id;
-	int m_token;
-	int m_index;
-	asynPortDriver* m_driver;
-	int m_asyn_id; // asyn parameter id
-	std::string m_asyn_name;
-public:
-	virtual void read() = 0;
-	virtual void write() = 0;
-	int id() const { return m_asyn_id; }
-	const std::string& name() const { return m_asyn_name; }
-	LOTParam(const std::string& lot_id, int token, int index, asynPortDriver* driver) :
-		m_lot_id(lot_id), m_token(token), m_index(index), m_driver(driver), m_asyn_id(-1), m_asyn_name("")
-	{
-		std::ostringstream oss;
-		oss << lot_id << "_" << TokenToName[token];
-		if (index != -1)
-		{
-			oss << "_" << index;
-		}
-		m_asyn_name = oss.str();
-	}
-};
-
-class LOTStringParam : public LOTParam
+/// \a macro, e.g. "$(P=)", expanded from the environment
+static std::string envMacro(const char* macro)
 {
-public:
-	LOTStringParam(const std::string& lot_id, int token, int index, asynPortDriver* driver) : LOTParam(lot_id, token, index, driver)
-	{
-		m_driver->createParam(m_asyn_name.c_str(), asynParamOctet, &m_asyn_id);
-	}
-	void read()
-	{
-		std::string s;
-		LOTUtils::get_str(m_lot_id, m_token, m_index, s);
-		m_driver->setStringParam(m_asyn_id, s);
-	}
-	void write()
-	{
-		std::string s;
-		m_driver->getStringParam(m_asyn_id, s);
-		LOTUtils::set_str(m_lot_id, m_token, m_index, s);
-	}
-};
-
-class LOTRealParam : public LOTParam
-{
-public:
-	LOTRealParam(const std::string& lot_id, int token, int index, asynPortDriver* driver) : LOTParam(lot_id, token, index, driver)
-	{
-		m_driver->createParam(m_asyn_name.c_str(), asynParamFloat64, &m_asyn_id);
-	}
-	void read()
-	{
-		double d;
-		LOTUtils::get(m_lot_id, m_token, m_index, d);
-		m_driver->setDoubleParam(m_asyn_id, d);
-	}
-	void write()
-	{
-		double d;
-		m_driver->getDoubleParam(m_asyn_id, &d);
-		LOTUtils::set(m_lot_id, m_token, m_index, d);
-	}
-};
+	char* value = macEnvExpand(macro);
+	std::string s(value != NULL ? value : "");
+	free(value);
+	return s;
+}
 
 asynStatus LOTPortDriver::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
 {
@@ -200,14 +78,27 @@ asynStatus LOTPortDriver::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
 	getParamName(function, &paramName);
 	try
 	{
+		LOTParam* lp = findLOTParam(function);
 		if (function == P_selectWavelength)
 		{
-			LOTUtils::select_wavelength(value);
+			startMove(value);
+		}
+		else if (lp != NULL)
+		{
+			LOTReading setpoint;
+			setpoint.value = value;
+			setDoubleParam(function, value);
+			postWrite(lp, setpoint);
+			noteMove();
 		}
-		else if (m_lot_params.find(function) != m_lot_params.end())
+		else if (function == P_scanStart || function == P_scanStop || function == P_scanStep)
 		{
 			setDoubleParam(function, value);
-			m_lot_params[function]->write();
+			generateScanPoints();
+		}
+		else if (function == P_predictWl)
+		{
+			predict(value);
 		}
 	    setStringParam(P_errMsg, "");
 		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
@@ -233,9 +124,10 @@ asynStatus LOTPortDriver::readFloat64(asynUser *pasynUser, epicsFloat64 *value)
 	getParamName(function, &paramName);
 	try
 	{
-		if (m_lot_params.find(function) != m_lot_params.end())
+		LOTParam* lp = findLOTParam(function);
+		if (lp != NULL)
 		{
-			m_lot_params[function]->read();
+			readParam(lp);
 		}
 		asynStatus status = asynPortDriver::readFloat64(pasynUser, value);
 		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
@@ -261,9 +153,10 @@ asynStatus LOTPortDriver::readOctet(asynUser *pasynUser, char *value, size_t max
 
 	try
 	{
-		if (m_lot_params.find(function) != m_lot_params.end())
+		LOTParam* lp = findLOTParam(function);
+		if (lp != NULL)
 		{
-			m_lot_params[function]->read();
+			readParam(lp);
 		}
 		asynStatus status = asynPortDriver::readOctet(pasynUser, value, maxChars, nActual, eomReason);
 		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
@@ -294,10 +187,17 @@ asynStatus LOTPortDriver::writeOctet(asynUser *pasynUser, const char *value, siz
 
 	try
 	{
-		if (m_lot_params.find(function) != m_lot_params.end())
+		LOTParam* lp = findLOTParam(function);
+		if (lp != NULL)
 		{
+			LOTReading setpoint;
+			setpoint.setStr(value_s.c_str());
 			setStringParam(function, value_s);
-			m_lot_params[function]->write();
+			postWrite(lp, setpoint);
+		}
+		else if (function == P_calMono)
+		{
+			m_cal_mono = value_s.c_str();
 		}
 	    setStringParam(P_errMsg, "");
 		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
@@ -327,11 +227,51 @@ asynStatus LOTPortDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
 	{
 		if (function == P_saveSetup)
 		{
-			LOTUtils::save_setup();
+			checkConnected();
+			sdkCall([]() { LOTUtils::save_setup(); });
 		}
 		else if (function == P_c_group)
 		{
-			LOTUtils::set_c_group(value);
+			checkConnected();
+			if (value != 0)
+			{
+				m_sdk.call(LOTSdkRequest::PriorityWrite, []() { }, value); // fails if the SDK cannot select the group
+			}
+			m_sdk.reserve(2 * m_lot_params.size() + 8, value);
+			m_group = value;
+		}
+		else if (function == P_refresh)
+		{
+			checkConnected();
+			refreshAll();
+		}
+		else if (function == P_diagReset)
+		{
+			resetDiagnostics();
+		}
+		else if (function == P_scanRun)
+		{
+			if (value != 0)
+			{
+				startScan();
+			}
+			else if (m_scan_busy) // a wakeup left signalled with no scan to take it would cut short the next scan's first dwell
+			{
+				m_scan_abort = true;
+				m_scan_wakeup.signal();
+			}
+		}
+		else if (function == P_calFit)
+		{
+			fitCalibration();
+		}
+		else if (function == P_calApply)
+		{
+			applyCalibration();
+		}
+		else if (function == P_calRollback)
+		{
+			rollbackCalibration();
 		}
 		setStringParam(P_errMsg, "");
 		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
@@ -349,242 +289,2177 @@ asynStatus LOTPortDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
 	}
 }
 
-/// EPICS driver report function for iocsh dbior command
-void LOTPortDriver::report(FILE* fp, int details)
-{
-	asynPortDriver::report(fp, details);
-}
-
-LOTParam* LOTPortDriver::addRealParam(const std::string& id, int token, bool writable, int index)
+asynStatus LOTPortDriver::writeFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements)
 {
-	//    std::cerr << "LOT: item " << id << " adding token " << TokenToName[token] << std::endl;
-	LOTParam* lp = new LOTRealParam(id, token, index, this);
-	char ind_str[10];
-	sprintf(ind_str, "%d", index);
-	int asyn_id = lp->id();
-	m_lot_params[asyn_id] = lp;
-	m_subst_file << "file \"${MSH150}/db/LOT_real.template\" {\n";
-	m_subst_file << "    { P=\"" << macEnvExpand("$(P=)") << "\",Q=\"" << macEnvExpand("$(Q=)") << "\",R=\"" << boost::to_upper_copy<std::string>(id) << ":" << TokenToDBName[token] << (index != -1 ? ind_str : "") <<
-		"\",PORT=\"" << portName << "\"" << ",PARAM=\"" << lp->name() << "\",DESC=\"" << TokenToName[token].substr(0, 39) <<
-		"\",SET=\"" << (writable ? "" : "#") << "\" }\n";
-	m_subst_file << "}\n\n";
-	return lp;
+	static const char* functionName = "writeFloat64Array";
+	int function = pasynUser->reason;
+	const char *paramName = NULL;
+	getParamName(function, &paramName);
+	std::vector<epicsFloat64>* cal_points = (function == P_calGrating ? &m_cal_grating : (function == P_calNominal ? &m_cal_nominal :
+		(function == P_calMeasured ? &m_cal_measured : NULL)));
+	const char* error = NULL;
+	if (function != P_scanPoints && cal_points == NULL)
+	{
+		error = "not writable";
+	}
+	else if (cal_points == NULL && nElements > MaxScanPoints)
+	{
+		error = "too many scan points";
+	}
+	else if (cal_points != NULL && nElements > MaxCalPoints)
+	{
+		error = "too many calibration points";
+	}
+	if (error != NULL)
+	{
+		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+			"%s:%s: function=%d, name=%s, nElements=%lu, error=%s",
+			driverName, functionName, function, paramName, static_cast<unsigned long>(nElements), error);
+		return asynError;
+	}
+	if (cal_points != NULL)
+	{
+		cal_points->assign(value, value + nElements);
+	}
+	else
+	{
+		m_scan_points.assign(value, value + nElements);
+		setIntegerParam(P_scanNpts, static_cast<int>(nElements));
+		callParamCallbacks();
+	}
+	doCallbacksFloat64Array(value, nElements, function, 0);
+	asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+		"%s:%s: function=%d, name=%s, nElements=%lu\n",
+		driverName, functionName, function, paramName, static_cast<unsigned long>(nElements));
+	return asynSuccess;
 }
 
-LOTParam* LOTPortDriver::addStringParam(const std::string& id, int token, bool writable, int index)
+asynStatus LOTPortDriver::readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn)
 {
-	//    std::cerr << "LOT: item " << id << " adding token " << TokenToName[token] << std::endl;
-	LOTParam* lp = new LOTStringParam(id, token, index, this);
-	char ind_str[10];
-	sprintf(ind_str, "%d", index);
-	int asyn_id = lp->id();
-	m_lot_params[asyn_id] = lp;
-
-	m_subst_file << "file \"${MSH150}/db/LOT_string.template\" {\n";
-	m_subst_file << "    { P=\"" << macEnvExpand("$(P=)") << "\",Q=\"" << macEnvExpand("$(Q=)") << "\",R=\"" << boost::to_upper_copy<std::string>(id) << ":" << TokenToDBName[token] << (index != -1 ? ind_str : "") <<
-		"\",PORT=\"" << portName << "\"" << ",PARAM=\"" << lp->name() << "\",DESC=\"" << TokenToName[token].substr(0, 39) <<
-		"\",SET=\"" << (writable ? "" : "#") << "\" }\n";
-	m_subst_file << "}\n\n";
-	return lp;
+	static const char* functionName = "readFloat64Array";
+	int function = pasynUser->reason;
+	const std::vector<epicsFloat64>* v = NULL;
+	ParamFamily* family = NULL;
+	ParamHistory* history = NULL;
+	if (function == P_scanPoints)
+	{
+		v = &m_scan_points;
+	}
+	else if (function == P_scanActual)
+	{
+		v = &m_scan_actual;
+	}
+	else if (function == P_scanTimes)
+	{
+		v = &m_scan_times;
+	}
+	else if (function == P_diagReadHist)
+	{
+		v = &m_diag_hist;
+	}
+	else if (function == P_calGrating || function == P_calNominal || function == P_calMeasured)
+	{
+		v = (function == P_calGrating ? &m_cal_grating : (function == P_calNominal ? &m_cal_nominal : &m_cal_measured));
+	}
+	else if (function == P_calFitGrating || function == P_calOffset || function == P_calResidual)
+	{
+		v = (function == P_calFitGrating ? &m_cal_fit_grating : (function == P_calOffset ? &m_cal_offset : &m_cal_residual));
+	}
+	else if (function == P_calAppliedGrating || function == P_calOldZord || function == P_calNewZord)
+	{
+		v = (function == P_calAppliedGrating ? &m_cal_applied_grating : (function == P_calOldZord ? &m_cal_old_zord : &m_cal_new_zord));
+	}
+	else if ((family = findFamily(function)) != NULL)
+	{
+		try
+		{
+			for (size_t k = 0; k < family->members.size(); ++k)
+			{
+				readParam(&m_lot_params[family->members[k]]);
+			}
+		}
+		catch (const std::exception& ex)
+		{
+			epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+				"%s:%s: function=%d, error=%s", driverName, functionName, function, ex.what());
+			*nIn = 0;
+			return asynError;
+		}
+		publishFamilies();
+		v = &family->values;
+	}
+	else if ((history = findHistory(function)) != NULL)
+	{
+		size_t n = history->history.copy(m_history_times.data(), m_history_values.data());
+		*nIn = (n < nElements ? n : nElements);
+		memcpy(value, (function == history->time_id ? m_history_times.data() : m_history_values.data()) + (n - *nIn), *nIn * sizeof(epicsFloat64));
+		return asynSuccess;
+	}
+	else
+	{
+		return asynPortDriver::readFloat64Array(pasynUser, value, nElements, nIn);
+	}
+	*nIn = (v->size() < nElements ? v->size() : nElements);
+	memcpy(value, v->data(), *nIn * sizeof(epicsFloat64));
+	asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+		"%s:%s: function=%d, nIn=%lu\n",
+		driverName, functionName, function, static_cast<unsigned long>(*nIn));
+	return asynSuccess;
 }
 
-void LOTPortDriver::addHardwareParams(const std::string& item)
+/// EPICS driver report function for iocsh dbior command
+void LOTPortDriver::report(FILE* fp, int details)
 {
-	int hardware_type;
-	std::string s;
-	std::list<std::string> mono_items;
-	double d;
-	LOTUtils::get_hardware_type(item, hardware_type);
-	switch (hardware_type)
+	fprintf(fp, "LOT: %lu parameter readings published, %lu suppressed as unchanged or within deadband\n", m_published, m_suppressed);
+	fprintf(fp, "LOT: %lu reads served from values less than %gs old\n", m_cache_hits, m_cache_max_age);
+	fprintf(fp, "LOT: %lu setpoints dropped in favour of a later one\n", m_writes_dropped);
+	LOTSdkArbiter::instance().report(fp);
+	if (m_group != 0)
 	{
-	case lotInterface:
-		std::cerr << "LOT: found lotInterface: " << item << std::endl;
-		break;
-	case lotSAM:
-		std::cerr << "LOT: found lotSAM: " << item << std::endl;
-		break;
-	case lotSlit:
-		std::cerr << "LOT: found lotSlit: " << item << std::endl;
-		break;
-	case lotFilterWheel:
-		std::cerr << "LOT: found lotFilterWheel: " << item << std::endl;
-		addRealParam(item, LOTTokens::FWheelPositions);
-		LOTUtils::get(item, LOTTokens::FWheelPositions, 0, d);
-		for (int i = 1; i <= d; ++i)
+		fprintf(fp, "LOT: port uses comms group %d\n", m_group);
+	}
+	if (!m_histories.empty())
+	{
+		fprintf(fp, "LOT: last %lu changes kept of %lu fast parameters\n", static_cast<unsigned long>(m_histories.front().history.capacity()),
+			static_cast<unsigned long>(m_histories.size()));
+	}
+	if (!m_calibration.applied().empty())
+	{
+		fprintf(fp, "LOT: zero orders of %lu gratings of %s recalibrated, CALROLLBACK restores them\n",
+			static_cast<unsigned long>(m_calibration.applied().size()), m_cal_mono.c_str());
+	}
+	fprintf(fp, "LOT: hardware %s, lost %lu times", (m_connected ? "connected" : "disconnected"), m_disconnects);
+	if (!m_connected)
+	{
+		fprintf(fp, ", %lu reconnect attempts failed, next in %gs", m_reconnect_failures, m_reconnect_delay);
+	}
+	fprintf(fp, "\n");
+	fprintf(fp, "LOT: %ld poll sweeps, last %.3f ms, mean %.3f ms, max %.3f ms, %ld with read errors\n", m_sweep_stats.count(),
+		1.0e3 * m_sweep_stats.last(), 1.0e3 * m_sweep_stats.mean(), 1.0e3 * m_sweep_stats.max(), m_sweep_stats.errors());
+	fprintf(fp, "LOT: %ld select_wavelength calls, last %.3f ms, mean %.3f ms, max %.3f ms, %ld failed\n", m_move_stats.count(),
+		1.0e3 * m_move_stats.last(), 1.0e3 * m_move_stats.mean(), 1.0e3 * m_move_stats.max(), m_move_stats.errors());
+	epicsTimeStamp now;
+	epicsTimeGetCurrent(&now);
+	for (auto it = m_lot_params.cbegin(); it != m_lot_params.cend(); ++it)
+	{
+		if (it->tripped())
 		{
-			addRealParam(item, LOTTokens::FWheelFilter, false, i);
+			fprintf(fp, "LOT: %s not polled after %d failed reads, next read in %.1fs: %s\n", it->name().c_str(), it->failures(),
+				it->retryIn(now), it->readError().c_str());
 		}
-		addRealParam(item, LOTTokens::FWheelCurrentPosition);
-		addRealParam(item, LOTTokens::lotMoveWithWavelength);
-		addStringParam(item, LOTTokens::lotDescriptor);
-		break;
-	case lotMono:
-		std::cerr << "LOT: found lotMono: " << item << std::endl;
-		addRealParam(item, LOTTokens::MonochromatorCurrentWL);
-		addRealParam(item, LOTTokens::MonochromatorCurrentGrating);
-		addRealParam(item, LOTTokens::MonochromatorModeSwitchNum);
-		addRealParam(item, LOTTokens::MonochromatorModeSwitchState);
-		addRealParam(item, LOTTokens::MonochromatorCanModeSwitch);
-		addRealParam(item, LOTTokens::MonochromatorAutoSelectWavelength);
-		addRealParam(item, LOTTokens::MonochromatorNumTurrets);
-		addRealParam(item, LOTTokens::TurretNumGratings);
-		LOTUtils::get(item, LOTTokens::TurretNumGratings, 0, d);
-		for (int i = 1; i <= d; ++i)
+	}
+	if (details > 0)
+	{
+		LOTUtils::error_report(fp);
+	}
+	else
+	{
+		fprintf(fp, "LOT: %lu SDK calls failed\n", LOTUtils::error_count());
+	}
+	if (details > 1)
+	{
+		for (size_t i = 0; i < m_transitions.size(); ++i)
 		{
-			addRealParam(item, LOTTokens::GratingSwitchWL, false, i);
+			const LOTTransitionModel::Item& item = m_transitions.item(i);
+			fprintf(fp, "  %s %s with wavelength, %lu switch wavelengths\n", item.id.c_str(), (item.moves ? "moves" : "does not move"),
+				static_cast<unsigned long>(item.switch_wl.size()));
 		}
-		addStringParam(item, LOTTokens::lotDescriptor);
-		LOTUtils::get_mono_items(item, mono_items);
-		for (auto m = mono_items.cbegin(); m != mono_items.cend(); ++m)
+		for (auto it = m_lot_params.cbegin(); it != m_lot_params.cend(); ++it)
 		{
-			std::cerr << "LOT: lotMono " << item << " has hardware item: " << *m << std::endl;
-			addHardwareParams(*m);
+			if (it->absDeadband() > 0.0 || it->relDeadband() > 0.0)
+			{
+				fprintf(fp, "  %s deadband abs=%g rel=%g\n", it->name().c_str(), it->absDeadband(), it->relDeadband());
+			}
+		}
+		fprintf(fp, "  %-44s %8s %6s %9s %9s %9s %9s %8s %6s %9s %9s %5s %5s\n", "parameter (latencies in ms)", "reads", "errors", "last", "mean",
+			"p99", "max", "writes", "errors", "mean", "max", "fails", "trips");
+		for (auto it = m_lot_params.cbegin(); it != m_lot_params.cend(); ++it)
+		{
+			const LOTLatencyStats& r = it->readStats();
+			const LOTLatencyStats& w = it->writeStats();
+			fprintf(fp, "  %-44s %8ld %6ld %9.3f %9.3f %9.3f %9.3f %8ld %6ld %9.3f %9.3f %5d %5lu%s\n", it->name().c_str(), r.count(), r.errors(),
+				1.0e3 * r.last(), 1.0e3 * r.mean(), 1.0e3 * r.percentile(0.99), 1.0e3 * r.max(), w.count(), w.errors(), 1.0e3 * w.mean(), 1.0e3 * w.max(),
+				it->failures(), it->trips(), (it->tripped() ? " tripped" : ""));
+			if (details > 2 && r.count() > 0)
+			{
+				fprintf(fp, "    read histogram, counts up to 1us, 2us, 4us ...: ");
+				r.print_bins(fp);
+				fprintf(fp, "\n");
+			}
 		}
-		break;
-	case lotUnknown:
-		std::cerr << "LOT: lotUnknown: " << item << std::endl;
-		break;
-	default:
-		std::cerr << "LOT: error: " << item << std::endl;
-		break;
 	}
+	asynPortDriver::report(fp, details);
 }
 
-
-/// Constructor for the #NetShrVarDriver class.
-/// Calls constructor for the asynPortDriver base class and sets up driver parameters.
-///
-/// @param[in] netvarint  interface pointer created by NetShrVarConfigure()
-/// @param[in] poll_ms  @copydoc initArg0
-/// @param[in] portName @copydoc initArg3
-LOTPortDriver::LOTPortDriver(const char *portName, const char* config_file, const char* subst_file, bool simulate)
-	: asynPortDriver(portName,
-		0, /* maxAddr */
-		asynInt32Mask | asynFloat64Mask | asynOctetMask | asynDrvUserMask, /* Interface mask */
-		asynInt32Mask | asynFloat64Mask | asynOctetMask,  /* Interrupt mask */
-		ASYN_CANBLOCK, /* asynFlags.  This driver can block but it is not multi-device */
-		1, /* Autoconnect */
-		0, /* Default priority */
-		0)	/* Default stack size*/
+/// Read \a lp for a client unless its last read is less than m_cache_max_age old, or a move is in progress;
+/// then the value already in the parameter library is used, or the error from that last read is rethrown.
+/// A parameter whose circuit breaker is open fails with its last error without an SDK call.
+/// Called with the port locked.
+void LOTPortDriver::readParam(LOTParam* lp)
 {
-	const char *functionName = "LOTPortDriver";
-
-	setupMappings();
-
-	createParam(P_configFileString, asynParamOctet, &P_configFile);
-	createParam(P_saveSetupString, asynParamInt32, &P_saveSetup);
-	createParam(P_selectWavelengthString, asynParamFloat64, &P_selectWavelength);
-	createParam(P_versionString, asynParamOctet, &P_version);
-	createParam(P_errMsgString, asynParamOctet, &P_errMsg);
-	createParam(P_c_groupString, asynParamInt32, &P_c_group);
-
-	setStringParam(P_configFile, config_file);
-	setStringParam(P_errMsg, "");
-	std::string lot_version;
-	LOTUtils::version(lot_version);
-	setStringParam(P_version, lot_version);
-	std::cerr << "LOT: SDK Version " << lot_version << std::endl;
-	std::cerr << "LOT: system model config file \"" << config_file << "\"" << std::endl;
-
-	if (simulate)
+	checkConnected();
+	epicsTimeStamp now;
+	epicsTimeGetCurrent(&now);
+	if (lp->breakerHolds(now))
 	{
-		std::cerr << "LOT: Enabling Simulation mode on comms objects" << std::endl;
+		throw std::runtime_error(lp->readError());
 	}
-	m_subst_file.open(subst_file, std::ios::out);
-
-	LOTUtils::build_system_model(config_file);
-	std::list<std::string> comms_list, hardware_list, mono_items;
-	LOTUtils::get_comms_list(comms_list);
-	for (auto c = comms_list.cbegin(); c != comms_list.cend(); ++c)
+	double age = lp->readAge(now);
+	if (moveInProgress() || (age >= 0.0 && age < m_cache_max_age) || !fetchParam(lp))
 	{
-		std::cerr << "LOT: comms object: " << *c << std::endl;
-		LOTParam* lp = addRealParam(*c, LOTTokens::SimulationMode);
-		if (simulate)
+		++m_cache_hits;
+		if (!lp->readOK() && age >= 0.0)
 		{
-			setDoubleParam(lp->id(), 1.0);
-			lp->write();
+			throw std::runtime_error(lp->readError());
 		}
+		return;
 	}
-	LOTUtils::initialise();
-	LOTUtils::get_hardware_list(hardware_list);
-	for (auto h = hardware_list.cbegin(); h != hardware_list.cend(); ++h)
+	if (!lp->readOK())
 	{
-		addHardwareParams(*h);
+		throw std::runtime_error(lp->readError());
 	}
-	m_subst_file.close();
-	std::cerr << "LOT: generated substitutions file \"" << subst_file << "\"" << std::endl;
-
-	epicsAtExit(epicsExitFunc, this);
+}
 
-	// Create the thread for background tasks (not used at present, could be used for I/O intr scanning) 
-	if (epicsThreadCreate("LOTPortDriverTask",
-		epicsThreadPriorityMedium,
-		epicsThreadGetStackSize(epicsThreadStackMedium),
-		(EPICSTHREADFUNC)pollerTask, this) == 0)
+/// Read \a lp on the SDK thread at read priority and publish it; returns false if the request was cancelled.
+/// Called with the port locked.
+bool LOTPortDriver::fetchParam(LOTParam* lp)
+{
+	m_read_request.param = lp;
+	sdkSubmit(&m_read_request);
+	m_sdk.wait(&m_read_request);
+	if (m_read_request.skipped())
 	{
-		printf("%s:%s: epicsThreadCreate failure\n", driverName, functionName);
-		return;
+		return false;
+	}
+	epicsTimeStamp now;
+	epicsTimeGetCurrent(&now);
+	if (m_read_request.reading.error.ok())
+	{
+		countRead(lp->publish(m_read_request.reading));
 	}
+	else if (LOTUtils::comms_lost(m_read_request.reading.error.code))
+	{
+		commsLost(m_read_request.reading.error.message());
+	}
+	recordRead(*lp, now, m_read_request.reading);
+	return true;
 }
 
-bool LOTPortDriver::m_shutdown_requested = false;
-
-void LOTPortDriver::updateValues()
+/// Re-read every parameter other than the static ones straight away, regardless of the cache; called with the port locked.
+void LOTPortDriver::refreshAll()
 {
-	lock();
 	for (auto it = m_lot_params.begin(); it != m_lot_params.end(); ++it)
 	{
-		it->second->read();
+		if (it->pollClass() != LOTParam::PollStatic || !it->hasValue())
+		{
+			fetchParam(&*it);
+		}
 	}
+	publishFamilies();
 	callParamCallbacks();
-	unlock();
 }
 
-void LOTPortDriver::epicsExitFunc(void* arg)
+/// Queue \a value to be written to \a lp, replacing any earlier setpoint for it that has not been sent yet.
+/// Returns without waiting for the SDK; a failed write is reported in ERRMSG by the poller. Called with the port locked.
+void LOTPortDriver::postWrite(LOTParam* lp, const LOTReading& value)
 {
-	LOTPortDriver* driver = static_cast<LOTPortDriver*>(arg);
-	if (driver == NULL)
+	checkConnected();
+	size_t i = static_cast<size_t>(m_lot_index[lp->id()]);
+	if (m_write_requests.size() <= i)
 	{
-		return;
+		m_write_requests.resize(i + 1);
+	}
+	if (!m_write_requests[i])
+	{
+		m_write_requests[i].reset(new LOTWriteRequest(lp));
+	}
+	LOTWriteRequest* req = m_write_requests[i].get();
+	bool dropped = false;
+	lp->setLastValue(value);
+	if (req->post(value, dropped))
+	{
+		m_sdk.wait(req); // the previous run() may have returned but not yet been marked complete
+		sdkSubmit(req);
+	}
+	if (dropped)
+	{
+		++m_writes_dropped;
+		setIntegerParam(P_writesDropped, static_cast<int>(m_writes_dropped));
 	}
-	driver->m_shutdown_requested = true;
-	epicsThreadSleep(0.1);
-	LOTUtils::close();
 }
 
-void LOTPortDriver::pollerTask(void* arg)
+/// Copy errors from asynchronous writes to ERRMSG, and their timings to the parameters' write statistics; called with the port locked
+void LOTPortDriver::publishWriteResults()
 {
-	LOTPortDriver* driver = (LOTPortDriver*)arg;
-	while (!m_shutdown_requested)
+	std::string error;
+	int code;
+	for (auto it = m_write_requests.begin(); it != m_write_requests.end(); ++it)
 	{
-		driver->updateValues();
-		epicsThreadSleep(0.5);
+		if (*it && (*it)->takeError(error, code))
+		{
+			std::cerr << "LOT: write to " << (*it)->param->name() << " failed: " << error << std::endl;
+			setStringParam(P_errMsg, error);
+			if (LOTUtils::comms_lost(code))
+			{
+				commsLost(error);
+			}
+		}
+		if (*it)
+		{
+			LOTLatencyStats stats;
+			(*it)->takeStats(stats);
+			(*it)->param->addWriteStats(stats);
+		}
 	}
 }
 
-extern "C" {
-
-	/// EPICS iocsh callable function to call constructor of NetShrVarInterface().
-	/// The function is registered via NetShrVarRegister().
-	///
-	/// @param[in] portName @copydoc initArg0
-	/// @param[in] configSection @copydoc initArg1
-	/// @param[in] configFile @copydoc initArg2
-	/// @param[in] pollPeriod @copydoc initArg3
-	/// @param[in] options @copydoc initArg4
-	int LOTConfigure(const char *portName, const char* configFile, const char* substFile, int simulate)
+/// Publish the SDK call statistics as the DIAG parameters, with latencies in milliseconds; called with the port locked.
+/// DIAGSLOWEST names the parameter with the highest mean read latency, the first place to look when sweeps are slow.
+void LOTPortDriver::publishDiagnostics()
+{
+	LOTLatencyStats reads, writes;
+	const LOTParam* slowest = NULL;
+	for (auto it = m_lot_params.cbegin(); it != m_lot_params.cend(); ++it)
 	{
-		try
+		reads.merge(it->readStats());
+		writes.merge(it->writeStats());
+		if (it->readStats().count() > 0 && (slowest == NULL || it->readStats().mean() > slowest->readStats().mean()))
 		{
-			LOTPortDriver* pd = new LOTPortDriver(portName, configFile, substFile, (simulate != 0));
-			return(asynSuccess);
+			slowest = &*it;
 		}
-		catch (const std::exception& ex)
+	}
+	setIntegerParam(P_diagSweeps, static_cast<int>(m_sweep_stats.count()));
+	setIntegerParam(P_diagSweepReads, m_sweep_reads);
+	setDoubleParam(P_diagSweepLast, 1.0e3 * m_sweep_stats.last());
+	setDoubleParam(P_diagSweepMean, 1.0e3 * m_sweep_stats.mean());
+	setDoubleParam(P_diagSweepMax, 1.0e3 * m_sweep_stats.max());
+	setIntegerParam(P_diagReads, static_cast<int>(reads.count()));
+	setIntegerParam(P_diagReadErrors, static_cast<int>(reads.errors()));
+	setDoubleParam(P_diagReadMean, 1.0e3 * reads.mean());
+	setDoubleParam(P_diagReadMax, 1.0e3 * reads.max());
+	setIntegerParam(P_diagWrites, static_cast<int>(writes.count()));
+	setIntegerParam(P_diagWriteErrors, static_cast<int>(writes.errors()));
+	setDoubleParam(P_diagWriteMean, 1.0e3 * writes.mean());
+	setDoubleParam(P_diagWriteMax, 1.0e3 * writes.max());
+	setIntegerParam(P_diagMoves, static_cast<int>(m_move_stats.count()));
+	setIntegerParam(P_diagMoveErrors, static_cast<int>(m_move_stats.errors()));
+	setDoubleParam(P_diagMoveLast, 1.0e3 * m_move_stats.last());
+	setDoubleParam(P_diagMoveMean, 1.0e3 * m_move_stats.mean());
+	setDoubleParam(P_diagMoveMax, 1.0e3 * m_move_stats.max());
+	setStringParam(P_diagSlowest, (slowest != NULL ? slowest->name().c_str() : ""));
+	int tripped = 0, failing = 0;
+	unsigned long trips = 0;
+	m_diag_tripped.clear();
+	for (auto it = m_lot_params.cbegin(); it != m_lot_params.cend(); ++it)
+	{
+		trips += it->trips();
+		if (it->tripped())
 		{
-			errlogSevPrintf(errlogFatal, "LOTConfigure failed: %s\n", ex.what());
-			return(asynError);
+			++tripped;
+			if (m_diag_tripped.size() + it->name().size() + 2 < LOT_BUFFER_SIZE) // the size of the DIAG:TRIPPED waveform
+			{
+				m_diag_tripped.append(m_diag_tripped.empty() ? "" : " ").append(it->name());
+			}
 		}
-	}
+		else if (it->failures() > 0)
+		{
+			++failing;
+		}
+	}
+	setIntegerParam(P_diagTripped, tripped);
+	setIntegerParam(P_diagFailing, failing);
+	setIntegerParam(P_diagTrips, static_cast<int>(trips));
+	setStringParam(P_diagTrippedList, m_diag_tripped);
+	setDoubleParam(P_diagSlowestMean, (slowest != NULL ? 1.0e3 * slowest->readStats().mean() : 0.0));
+	for (int i = 0; i < LOTLatencyStats::NBINS; ++i)
+	{
+		m_diag_hist[i] = static_cast<epicsFloat64>(reads.bin(i));
+	}
+	doCallbacksFloat64Array(m_diag_hist.data(), m_diag_hist.size(), P_diagReadHist, 0);
+}
+
+/// Clear the SDK call statistics and publish them; called with the port locked
+void LOTPortDriver::resetDiagnostics()
+{
+	for (auto it = m_lot_params.begin(); it != m_lot_params.end(); ++it)
+	{
+		it->resetStats();
+	}
+	m_sweep_stats.reset();
+	m_sweep_reads = 0;
+	m_move_stats.reset();
+	publishDiagnostics();
+	callParamCallbacks();
+}
+
+/// Make \a value the next setpoint to write; returns true if the request needs submitting, and sets
+/// \a dropped if a setpoint that had not been written yet was replaced
+bool LOTWriteRequest::post(const LOTReading& value, bool& dropped)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	dropped = m_has_next;
+	m_next = value;
+	m_has_next = true;
+	if (m_active)
+	{
+		return false;
+	}
+	m_active = true;
+	return true;
+}
+
+/// Return the error, and its SDK error code, from the last failed write if it has not been taken before
+bool LOTWriteRequest::takeError(std::string& error, int& code)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	if (!m_error_new)
+	{
+		return false;
+	}
+	error = m_error;
+	code = m_error_code;
+	m_error_new = false;
+	return true;
+}
+
+/// Write setpoints until there is none waiting, so one posted while a write is in progress follows it
+void LOTWriteRequest::run()
+{
+	LOTReading value;
+	while (true)
+	{
+		{
+			epicsGuard<epicsMutex> guard(m_lock);
+			if (!m_has_next)
+			{
+				m_active = false;
+				return;
+			}
+			value = m_next;
+			m_has_next = false;
+		}
+		epicsTimeStamp start, end;
+		epicsTimeGetCurrent(&start);
+		try
+		{
+			param->put(value);
+			epicsTimeGetCurrent(&end);
+			epicsGuard<epicsMutex> guard(m_lock);
+			m_stats.add(epicsTimeDiffInSeconds(&end, &start));
+		}
+		catch (const LOTException& ex)
+		{
+			epicsTimeGetCurrent(&end);
+			epicsGuard<epicsMutex> guard(m_lock);
+			m_stats.add(epicsTimeDiffInSeconds(&end, &start), false);
+			m_error = ex.what();
+			m_error_code = ex.errcode();
+			m_error_new = true;
+		}
+		catch (const std::exception& ex)
+		{
+			epicsTimeGetCurrent(&end);
+			epicsGuard<epicsMutex> guard(m_lock);
+			m_stats.add(epicsTimeDiffInSeconds(&end, &start), false);
+			m_error = ex.what();
+			m_error_code = LOT_Error;
+			m_error_new = true;
+		}
+	}
+}
+
+/// Add the writes made since the last call to \a stats
+void LOTWriteRequest::takeStats(LOTLatencyStats& stats)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	stats.merge(m_stats);
+	m_stats.reset();
+}
+
+void LOTPortDriver::countRead(bool published)
+{
+	if (published)
+	{
+		++m_published;
+	}
+	else
+	{
+		++m_suppressed;
+	}
+}
+
+/// Append a parameter to the table; the pointer returned is valid only until the next parameter is added.
+LOTParam* LOTPortDriver::addParam(const std::string& id, int token, LOTParam::ParamType type, int index)
+{
+	m_lot_params.push_back(LOTParam(id, token, index, type, this));
+	int asyn_id = m_lot_params.back().id();
+	if (asyn_id >= static_cast<int>(m_lot_index.size()))
+	{
+		m_lot_index.resize(asyn_id + 1, -1);
+	}
+	m_lot_index[asyn_id] = static_cast<int>(m_lot_params.size() - 1);
+	return &m_lot_params.back();
+}
+
+LOTParam* LOTPortDriver::addRealParam(const std::string& id, int token, bool writable, int index)
+{
+	//    std::cerr << "LOT: item " << id << " adding token " << LOTParam::tokenName(token) << std::endl;
+	LOTParam* lp = addParam(id, token, LOTParam::Real, index);
+	m_layout.addParam(id, token, index, false, writable);
+	if (m_subst_file.is_open() && (index == -1 || m_indexed_records))
+	{
+		LOTParam::writeSubstitution(m_subst_file, LOTParam::Real, id, token, index, writable, envMacro("$(P=)"), envMacro("$(Q=)"), portName);
+	}
+	if (lp->pollClass() == LOTParam::PollFast)
+	{
+		addHistory(m_lot_params.size() - 1);
+	}
+	return lp;
+}
+
+LOTParam* LOTPortDriver::addStringParam(const std::string& id, int token, bool writable, int index)
+{
+	//    std::cerr << "LOT: item " << id << " adding token " << LOTParam::tokenName(token) << std::endl;
+	LOTParam* lp = addParam(id, token, LOTParam::String, index);
+	m_layout.addParam(id, token, index, true, writable);
+	if (m_subst_file.is_open() && (index == -1 || m_indexed_records))
+	{
+		LOTParam::writeSubstitution(m_subst_file, LOTParam::String, id, token, index, writable, envMacro("$(P=)"), envMacro("$(Q=)"), portName);
+	}
+	return lp;
+}
+
+/// Gather the indexed real parameters of each (item, token), as added one after the other by addHardwareParams(), into
+/// a ParamFamily with an array parameter of its own, and write its LOT_realArray.template substitutions; called once
+/// every parameter has been added.
+void LOTPortDriver::addFamilies()
+{
+	for (size_t i = 0; i < m_lot_params.size(); ++i)
+	{
+		const LOTParam& lp = m_lot_params[i];
+		if (lp.index() == -1 || lp.type() != LOTParam::Real)
+		{
+			continue;
+		}
+		if (!m_families.empty())
+		{
+			const LOTParam& last = m_lot_params[m_families.back().members.back()];
+			if (last.token() == lp.token() && last.lotId() == lp.lotId()) // ids are interned
+			{
+				m_families.back().members.push_back(i);
+				continue;
+			}
+		}
+		ParamFamily family;
+		family.asyn_id = -1;
+		family.members.push_back(i);
+		family.published = false;
+		m_families.push_back(family);
+	}
+	for (auto f = m_families.begin(); f != m_families.end(); ++f)
+	{
+		const LOTParam& first = m_lot_params[f->members.front()];
+		createParam(LOTParam::paramName(first.lotId(), first.token(), -1).c_str(), asynParamFloat64Array, &f->asyn_id);
+		f->values.assign(f->members.size(), 0.0);
+		if (m_subst_file.is_open())
+		{
+			LOTParam::writeArraySubstitution(m_subst_file, first.lotId(), first.token(), static_cast<int>(f->members.size()),
+				envMacro("$(P=)"), envMacro("$(Q=)"), portName);
+		}
+	}
+}
+
+/// Publish the array of each family whose values have changed since it was last published; called with the port locked
+void LOTPortDriver::publishFamilies()
+{
+	for (auto f = m_families.begin(); f != m_families.end(); ++f)
+	{
+		bool changed = !f->published;
+		for (size_t k = 0; k < f->members.size(); ++k)
+		{
+			const LOTParam& lp = m_lot_params[f->members[k]];
+			double d;
+			if (lp.hasValue() && getDoubleParam(lp.id(), &d) == asynSuccess && d != f->values[k])
+			{
+				f->values[k] = d;
+				changed = true;
+			}
+		}
+		if (changed)
+		{
+			f->published = true;
+			doCallbacksFloat64Array(f->values.data(), f->values.size(), f->asyn_id, 0);
+		}
+	}
+}
+
+/// Keep the history of m_lot_params[\a param] and add the asyn parameters it is published as
+void LOTPortDriver::addHistory(size_t param)
+{
+	const LOTParam& lp = m_lot_params[param];
+	ParamHistory h;
+	h.param = param;
+	createParam((lp.name() + "_HISTTIME").c_str(), asynParamFloat64Array, &h.time_id);
+	createParam((lp.name() + "_HISTVALUE").c_str(), asynParamFloat64Array, &h.value_id);
+	createParam((lp.name() + "_HISTSEQ").c_str(), asynParamInt32, &h.seq_id);
+	setIntegerParam(h.seq_id, 0);
+	m_histories.push_back(h);
+	if (m_history_index.size() <= param)
+	{
+		m_history_index.resize(param + 1, -1);
+	}
+	m_history_index[param] = static_cast<int>(m_histories.size() - 1);
+	if (m_history_times.size() < h.history.capacity())
+	{
+		m_history_times.resize(h.history.capacity());
+		m_history_values.resize(h.history.capacity());
+	}
+	if (m_subst_file.is_open() && (lp.index() == -1 || m_indexed_records))
+	{
+		LOTParam::writeHistorySubstitution(m_subst_file, lp.lotId(), lp.token(), lp.index(), static_cast<int>(h.history.capacity()),
+			envMacro("$(P=)"), envMacro("$(Q=)"), portName);
+	}
+}
+
+/// Publish the history of each parameter with changes recorded since it was last published; called with the port locked
+void LOTPortDriver::publishHistory()
+{
+	for (auto h = m_histories.begin(); h != m_histories.end(); ++h)
+	{
+		if (!h->history.unpublished())
+		{
+			continue;
+		}
+		size_t n = h->history.copy(m_history_times.data(), m_history_values.data());
+		doCallbacksFloat64Array(m_history_times.data(), n, h->time_id, 0);
+		doCallbacksFloat64Array(m_history_values.data(), n, h->value_id, 0);
+		setIntegerParam(h->seq_id, static_cast<int>(h->history.seq()));
+		h->history.published();
+	}
+}
+
+/// the history with \a function as its times or values parameter, or NULL
+LOTPortDriver::ParamHistory* LOTPortDriver::findHistory(int function)
+{
+	for (auto h = m_histories.begin(); h != m_histories.end(); ++h)
+	{
+		if (h->time_id == function || h->value_id == function)
+		{
+			return &*h;
+		}
+	}
+	return NULL;
+}
+
+/// the family published as asyn parameter \a function, or NULL
+LOTPortDriver::ParamFamily* LOTPortDriver::findFamily(int function)
+{
+	for (auto f = m_families.begin(); f != m_families.end(); ++f)
+	{
+		if (f->asyn_id == function)
+		{
+			return &*f;
+		}
+	}
+	return NULL;
+}
+
+void LOTPortDriver::addHardwareParams(const std::string& item)
+{
+	int hardware_type;
+	std::string s;
+	std::list<std::string> mono_items;
+	double d;
+	sdkCall([&]() { LOTUtils::get_hardware_type(item, hardware_type); });
+	m_layout.addItem(item, hardware_type);
+	switch (hardware_type)
+	{
+	case lotInterface:
+		std::cerr << "LOT: found lotInterface: " << item << std::endl;
+		break;
+	case lotSAM:
+		std::cerr << "LOT: found lotSAM: " << item << std::endl;
+		break;
+	case lotSlit:
+		std::cerr << "LOT: found lotSlit: " << item << std::endl;
+		break;
+	case lotFilterWheel:
+		std::cerr << "LOT: found lotFilterWheel: " << item << std::endl;
+		addRealParam(item, LOTTokens::FWheelPositions);
+		sdkCall([&]() { LOTUtils::get(item, LOTTokens::FWheelPositions, 0, d); });
+		for (int i = 1; i <= d; ++i)
+		{
+			addRealParam(item, LOTTokens::FWheelFilter, false, i);
+		}
+		addRealParam(item, LOTTokens::FWheelCurrentPosition);
+		addRealParam(item, LOTTokens::lotMoveWithWavelength);
+		addStringParam(item, LOTTokens::lotDescriptor);
+		break;
+	case lotMono:
+		std::cerr << "LOT: found lotMono: " << item << std::endl;
+		addRealParam(item, LOTTokens::MonochromatorCurrentWL);
+		addRealParam(item, LOTTokens::MonochromatorCurrentGrating);
+		addRealParam(item, LOTTokens::MonochromatorModeSwitchNum);
+		addRealParam(item, LOTTokens::MonochromatorModeSwitchState);
+		addRealParam(item, LOTTokens::MonochromatorCanModeSwitch);
+		addRealParam(item, LOTTokens::MonochromatorAutoSelectWavelength);
+		addRealParam(item, LOTTokens::MonochromatorNumTurrets);
+		addRealParam(item, LOTTokens::TurretNumGratings);
+		sdkCall([&]() { LOTUtils::get(item, LOTTokens::TurretNumGratings, 0, d); });
+		for (int i = 1; i <= d; ++i)
+		{
+			addRealParam(item, LOTTokens::GratingSwitchWL, false, i);
+		}
+		addStringParam(item, LOTTokens::lotDescriptor);
+		sdkCall([&]() { LOTUtils::get_mono_items(item, mono_items); });
+		for (auto m = mono_items.cbegin(); m != mono_items.cend(); ++m)
+		{
+			std::cerr << "LOT: lotMono " << item << " has hardware item: " << *m << std::endl;
+			addHardwareParams(*m);
+		}
+		break;
+	case lotUnknown:
+		std::cerr << "LOT: lotUnknown: " << item << std::endl;
+		break;
+	default:
+		std::cerr << "LOT: error: " << item << std::endl;
+		break;
+	}
+}
+
+
+/// Constructor for the #NetShrVarDriver class.
+/// Calls constructor for the asynPortDriver base class and sets up driver parameters.
+///
+/// @param[in] netvarint  interface pointer created by NetShrVarConfigure()
+/// @param[in] poll_ms  @copydoc initArg0
+/// @param[in] portName @copydoc initArg3
+/// @param[in] group @copydoc initArg5
+LOTPortDriver::LOTPortDriver(const char *portName, const char* config_file, const char* subst_file, bool simulate, int options, int group)
+	: asynPortDriver(portName,
+		0, /* maxAddr */
+		asynInt32Mask | asynFloat64Mask | asynOctetMask | asynFloat64ArrayMask | asynDrvUserMask, /* Interface mask */
+		asynInt32Mask | asynFloat64Mask | asynOctetMask | asynFloat64ArrayMask,  /* Interrupt mask */
+		ASYN_CANBLOCK, /* asynFlags.  This driver can block but it is not multi-device */
+		1, /* Autoconnect */
+		0, /* Default priority */
+		0),	/* Default stack size*/
+		m_shutdown_requested(false), m_tasks(0), m_indexed_records((options & LOTOptionNoIndexedRecords) == 0), m_sdk(LOTSdkArbiter::instance().queue()),
+		m_sdk_generation(0), m_group(group), m_connected(true), m_sweep_comms_lost(false), m_reconnect_min(1.0), m_reconnect_max(60.0),
+		m_reconnect_delay(1.0), m_disconnects(0), m_reconnect_failures(0), m_breaker_failures(3), m_breaker_retry(60.0),
+		m_fast_period(0.5), m_slow_period(5.0), m_min_period(0.05), m_settle_time(2.0), m_wl_tolerance(0.01), m_poll_period(0.5),
+		m_published(0), m_suppressed(0), m_cache_max_age(0.5), m_cache_hits(0), m_read_request(LOTSdkRequest::PriorityRead),
+		m_writes_dropped(0), m_sweep_reads(0), m_move_port(NULL), m_wl_setpoint(0.0), m_wl_setpoint_valid(false), m_move_target(0.0),
+		m_moves_requested(0), m_moves_started(0), m_moves_completed(0), m_scan_busy(false), m_scan_abort(false)
+{
+	const char *functionName = "LOTPortDriver";
+
+	epicsTimeGetCurrent(&m_last_move);
+	epicsTimeGetCurrent(&m_next_reconnect);
+	LOTParam::setupMappings();
+	m_sdk_generation = LOTSdkArbiter::instance().open(portName, config_file, simulate);
+
+	createParam(P_configFileString, asynParamOctet, &P_configFile);
+	createParam(P_saveSetupString, asynParamInt32, &P_saveSetup);
+	createParam(P_selectWavelengthString, asynParamFloat64, &P_selectWavelength);
+	createParam(P_versionString, asynParamOctet, &P_version);
+	createParam(P_errMsgString, asynParamOctet, &P_errMsg);
+	createParam(P_c_groupString, asynParamInt32, &P_c_group);
+	createParam(P_suppressedString, asynParamInt32, &P_suppressed);
+	createParam(P_moveBusyString, asynParamInt32, &P_moveBusy);
+	createParam(P_moveDoneString, asynParamInt32, &P_moveDone);
+	createParam(P_refreshString, asynParamInt32, &P_refresh);
+	createParam(P_writesDroppedString, asynParamInt32, &P_writesDropped);
+	createParam(P_scanPointsString, asynParamFloat64Array, &P_scanPoints);
+	createParam(P_scanStartString, asynParamFloat64, &P_scanStart);
+	createParam(P_scanStopString, asynParamFloat64, &P_scanStop);
+	createParam(P_scanStepString, asynParamFloat64, &P_scanStep);
+	createParam(P_scanNptsString, asynParamInt32, &P_scanNpts);
+	createParam(P_scanDwellString, asynParamFloat64, &P_scanDwell);
+	createParam(P_scanToleranceString, asynParamFloat64, &P_scanTolerance);
+	createParam(P_scanTimeoutString, asynParamFloat64, &P_scanTimeout);
+	createParam(P_scanRunString, asynParamInt32, &P_scanRun);
+	createParam(P_scanBusyString, asynParamInt32, &P_scanBusy);
+	createParam(P_scanProgressString, asynParamInt32, &P_scanProgress);
+	createParam(P_scanActualString, asynParamFloat64Array, &P_scanActual);
+	createParam(P_scanTimesString, asynParamFloat64Array, &P_scanTimes);
+	createParam(P_scanStatusString, asynParamOctet, &P_scanStatus);
+	createParam(P_scanOrderString, asynParamInt32, &P_scanOrder);
+	createParam(P_predictWlString, asynParamFloat64, &P_predictWl);
+	createParam(P_predictGratingString, asynParamInt32, &P_predictGrating);
+	createParam(P_predictChangesString, asynParamInt32, &P_predictChanges);
+	createParam(P_predictStateString, asynParamOctet, &P_predictState);
+	createParam(P_connectedString, asynParamInt32, &P_connected);
+	createParam(P_disconnectsString, asynParamInt32, &P_disconnects);
+	createParam(P_diagSweepsString, asynParamInt32, &P_diagSweeps);
+	createParam(P_diagSweepReadsString, asynParamInt32, &P_diagSweepReads);
+	createParam(P_diagSweepLastString, asynParamFloat64, &P_diagSweepLast);
+	createParam(P_diagSweepMeanString, asynParamFloat64, &P_diagSweepMean);
+	createParam(P_diagSweepMaxString, asynParamFloat64, &P_diagSweepMax);
+	createParam(P_diagReadsString, asynParamInt32, &P_diagReads);
+	createParam(P_diagReadErrorsString, asynParamInt32, &P_diagReadErrors);
+	createParam(P_diagReadMeanString, asynParamFloat64, &P_diagReadMean);
+	createParam(P_diagReadMaxString, asynParamFloat64, &P_diagReadMax);
+	createParam(P_diagReadHistString, asynParamFloat64Array, &P_diagReadHist);
+	createParam(P_diagWritesString, asynParamInt32, &P_diagWrites);
+	createParam(P_diagWriteErrorsString, asynParamInt32, &P_diagWriteErrors);
+	createParam(P_diagWriteMeanString, asynParamFloat64, &P_diagWriteMean);
+	createParam(P_diagWriteMaxString, asynParamFloat64, &P_diagWriteMax);
+	createParam(P_diagMovesString, asynParamInt32, &P_diagMoves);
+	createParam(P_diagMoveErrorsString, asynParamInt32, &P_diagMoveErrors);
+	createParam(P_diagMoveLastString, asynParamFloat64, &P_diagMoveLast);
+	createParam(P_diagMoveMeanString, asynParamFloat64, &P_diagMoveMean);
+	createParam(P_diagMoveMaxString, asynParamFloat64, &P_diagMoveMax);
+	createParam(P_diagSlowestString, asynParamOctet, &P_diagSlowest);
+	createParam(P_diagSlowestMeanString, asynParamFloat64, &P_diagSlowestMean);
+	createParam(P_diagResetString, asynParamInt32, &P_diagReset);
+	createParam(P_diagTrippedString, asynParamInt32, &P_diagTripped);
+	createParam(P_diagFailingString, asynParamInt32, &P_diagFailing);
+	createParam(P_diagTripsString, asynParamInt32, &P_diagTrips);
+	createParam(P_diagTrippedListString, asynParamOctet, &P_diagTrippedList);
+	createParam(P_calGratingString, asynParamFloat64Array, &P_calGrating);
+	createParam(P_calNominalString, asynParamFloat64Array, &P_calNominal);
+	createParam(P_calMeasuredString, asynParamFloat64Array, &P_calMeasured);
+	createParam(P_calMonoString, asynParamOctet, &P_calMono);
+	createParam(P_calFitString, asynParamInt32, &P_calFit);
+	createParam(P_calApplyString, asynParamInt32, &P_calApply);
+	createParam(P_calRollbackString, asynParamInt32, &P_calRollback);
+	createParam(P_calFitGratingString, asynParamFloat64Array, &P_calFitGrating);
+	createParam(P_calOffsetString, asynParamFloat64Array, &P_calOffset);
+	createParam(P_calResidualString, asynParamFloat64Array, &P_calResidual);
+	createParam(P_calAppliedString, asynParamInt32, &P_calApplied);
+	createParam(P_calAppliedGratingString, asynParamFloat64Array, &P_calAppliedGrating);
+	createParam(P_calOldZordString, asynParamFloat64Array, &P_calOldZord);
+	createParam(P_calNewZordString, asynParamFloat64Array, &P_calNewZord);
+	createParam(P_calStatusString, asynParamOctet, &P_calStatus);
+
+	setStringParam(P_configFile, config_file);
+	setStringParam(P_errMsg, "");
+	setIntegerParam(P_suppressed, 0);
+	setIntegerParam(P_moveBusy, 0);
+	setIntegerParam(P_moveDone, 1);
+	setIntegerParam(P_writesDropped, 0);
+	setDoubleParam(P_scanStart, 0.0);
+	setDoubleParam(P_scanStop, 0.0);
+	setDoubleParam(P_scanStep, 0.0);
+	setIntegerParam(P_scanNpts, 0);
+	setDoubleParam(P_scanDwell, 0.0);
+	setDoubleParam(P_scanTolerance, 0.0);
+	setDoubleParam(P_scanTimeout, 10.0);
+	setIntegerParam(P_scanRun, 0);
+	setIntegerParam(P_scanBusy, 0);
+	setIntegerParam(P_scanProgress, 0);
+	setStringParam(P_scanStatus, "Idle");
+	setIntegerParam(P_scanOrder, 0);
+	setIntegerParam(P_c_group, m_group);
+	setIntegerParam(P_connected, 1);
+	setIntegerParam(P_disconnects, 0);
+	m_diag_hist.resize(LOTLatencyStats::NBINS);
+	m_diag_tripped.reserve(LOT_BUFFER_SIZE);
+	setIntegerParam(P_diagReset, 0);
+	publishDiagnostics();
+	m_scan_actual.reserve(MaxScanPoints);
+	m_scan_times.reserve(MaxScanPoints);
+	setIntegerParam(P_calApplied, 0);
+	setStringParam(P_calStatus, "Idle");
+	std::string lot_version;
+	sdkCall([&]() { LOTUtils::version(lot_version); });
+	setStringParam(P_version, lot_version);
+	std::cerr << "LOT: SDK Version " << lot_version << std::endl;
+	std::cerr << "LOT: system model config file \"" << config_file << "\"" << std::endl;
+	if (m_group != 0)
+	{
+		std::cerr << "LOT: port " << portName << " uses comms group " << m_group << std::endl;
+	}
+
+	if (simulate)
+	{
+		std::cerr << "LOT: Enabling Simulation mode on comms objects" << std::endl;
+	}
+
+	// the cache is only valid for the same system model and the same values written to the substitutions file
+	std::string layout_file = std::string(subst_file) + ".layout";
+	std::ostringstream layout_key;
+	layout_key << portName << "\n" << envMacro("$(P=)") << "\n" << envMacro("$(Q=)") << "\n" << m_group << "\n" << m_indexed_records;
+	std::string layout_hash = LOTLayout::hash(config_file, layout_key.str());
+	bool cached = ((options & LOTOptionForceEnumerate) == 0 && m_layout.load(layout_file, layout_hash));
+	std::ifstream subst_in(subst_file);
+	bool write_subst = (!cached || !subst_in.good());
+	subst_in.close();
+	if (write_subst)
+	{
+		m_subst_file.open(subst_file, std::ios::out);
+	}
+
+	std::list<std::string> comms_list, hardware_list;
+	LOTSystemModel model; // the model as LOTMakeSubstitutions reads it, checked against the SDK when it is enumerated
+	bool have_model = false;
+	if (!cached)
+	{
+		sdkCall([&]() {
+			LOTUtils::get_comms_list(comms_list);
+			LOTUtils::get_hardware_list(hardware_list);
+		});
+		have_model = loadSystemModel(config_file, model);
+		if (m_group != 0)
+		{
+			selectGroup(have_model ? &model : NULL, comms_list, hardware_list);
+		}
+	}
+	else
+	{
+		std::cerr << "LOT: using parameter layout cached in \"" << layout_file << "\"" << std::endl;
+		comms_list.assign(m_layout.comms.begin(), m_layout.comms.end());
+	}
+	LOTLayout layout; // the cached one, replayed below; m_layout records the parameters again as they are added
+	layout.params.swap(m_layout.params);
+	m_layout.comms.assign(comms_list.begin(), comms_list.end());
+	for (auto c = comms_list.cbegin(); c != comms_list.cend(); ++c)
+	{
+		std::cerr << "LOT: comms object: " << *c << std::endl;
+		addRealParam(*c, LOTTokens::SimulationMode); // LOTSdkArbiter::open() has already put it in simulation mode if wanted
+	}
+	if (cached)
+	{
+		// the comms parameters were added first, as when the layout was saved
+		for (auto p = layout.params.cbegin() + comms_list.size(); p != layout.params.cend(); ++p)
+		{
+			if (p->is_string)
+			{
+				addStringParam(p->id, p->token, p->writable, p->index);
+			}
+			else
+			{
+				addRealParam(p->id, p->token, p->writable, p->index);
+			}
+		}
+		epicsTimeStamp now;
+		epicsTimeGetCurrent(&now);
+		for (size_t k = 0; k < layout.params.size() && k < m_lot_params.size(); ++k)
+		{
+			if (layout.params[k].has_value && m_lot_params[k].pollClass() == LOTParam::PollStatic)
+			{
+				LOTReading reading;
+				reading.value = layout.params[k].value;
+				reading.setStr(layout.params[k].str.c_str());
+				m_lot_params[k].publish(reading);
+				m_lot_params[k].setReadStatus(now, LOTError());
+			}
+		}
+	}
+	else
+	{
+		for (auto h = hardware_list.cbegin(); h != hardware_list.cend(); ++h)
+		{
+			addHardwareParams(*h);
+		}
+		if (have_model)
+		{
+			checkSystemModel(config_file, model);
+		}
+	}
+	addFamilies();
+	if (write_subst)
+	{
+		m_subst_file.close();
+		std::cerr << "LOT: generated substitutions file \"" << subst_file << "\"" << std::endl;
+	}
+	else
+	{
+		std::cerr << "LOT: substitutions file \"" << subst_file << "\" is up to date" << std::endl;
+	}
+	for (size_t i = 0; i < m_lot_params.size(); ++i)
+	{
+		if (m_lot_params[i].token() == LOTTokens::MonochromatorCurrentWL)
+		{
+			m_wl_params.push_back(i);
+		}
+	}
+	if (!m_wl_params.empty())
+	{
+		m_cal_mono = m_lot_params[m_wl_params.front()].lotId();
+	}
+	setStringParam(P_calMono, m_cal_mono);
+	readStaticValues();
+	if (!cached)
+	{
+		saveLayout(layout_file, layout_hash);
+	}
+	// most switch wavelengths are static parameters, so are in the parameter library already
+	LOTTransitionModel::Getter getOr = [this](const std::string& id, int token, int index, double def) {
+		double d;
+		for (auto it = m_lot_params.cbegin(); it != m_lot_params.cend(); ++it)
+		{
+			if (it->token() == token && it->index() == index && it->hasValue() && it->readOK() && it->lotId() == id &&
+				getDoubleParam(it->id(), &d) == asynSuccess)
+			{
+				return d;
+			}
+		}
+		return LOTTransitionModel::sdkValue(id, token, index, def);
+	};
+	sdkCall([&]() {
+		for (auto it = m_layout.items.cbegin(); it != m_layout.items.cend(); ++it)
+		{
+			m_transitions.addItem(it->id, it->type, getOr);
+		}
+	});
+	lock();
+	predict(0.0);
+	unlock();
+
+	epicsAtExit(epicsExitFunc, this);
+
+	// Create the thread for background tasks (not used at present, could be used for I/O intr scanning) 
+	if (epicsThreadCreate("LOTPortDriverTask",
+		epicsThreadPriorityMedium,
+		epicsThreadGetStackSize(epicsThreadStackMedium),
+		(EPICSTHREADFUNC)pollerTask, this) == 0)
+	{
+		printf("%s:%s: epicsThreadCreate failure\n", driverName, functionName);
+		return;
+	}
+	lock();
+	++m_tasks;
+	unlock();
+	if (epicsThreadCreate("LOTMoveTask",
+		epicsThreadPriorityMedium,
+		epicsThreadGetStackSize(epicsThreadStackMedium),
+		(EPICSTHREADFUNC)moveTask, this) == 0)
+	{
+		printf("%s:%s: epicsThreadCreate failure\n", driverName, functionName);
+		return;
+	}
+	lock();
+	++m_tasks;
+	unlock();
+	if (epicsThreadCreate("LOTScanTask",
+		epicsThreadPriorityMedium,
+		epicsThreadGetStackSize(epicsThreadStackMedium),
+		(EPICSTHREADFUNC)scanTask, this) == 0)
+	{
+		printf("%s:%s: epicsThreadCreate failure\n", driverName, functionName);
+		return;
+	}
+	lock();
+	++m_tasks;
+	unlock();
+	m_move_port = new LOTMovePort((std::string(portName) + "_MOVE").c_str(), this);
+}
+
+/// Parse \a config_file into \a model as LOTMakeSubstitutions and selectGroup() read it, reporting anything it
+/// could not place; returns false if it cannot be parsed at all
+bool LOTPortDriver::loadSystemModel(const std::string& config_file, LOTSystemModel& model)
+{
+	try
+	{
+		model.load(config_file);
+	}
+	catch (const std::exception& ex)
+	{
+		errlogSevPrintf(errlogMinor, "LOT: %s: LOTMakeSubstitutions cannot read this system model: %s\n", portName, ex.what());
+		return false;
+	}
+	for (auto w = model.warnings().cbegin(); w != model.warnings().cend(); ++w)
+	{
+		errlogSevPrintf(errlogMinor, "LOT: %s: system model \"%s\": %s\n", portName, config_file.c_str(), w->c_str());
+	}
+	return true;
+}
+
+/// Keep only the comms objects and hardware of \a comms_list and \a hardware_list in comms group m_group, according
+/// to \a model, as the SDK does not say which group an item belongs to. Items the model does not describe are kept,
+/// as is everything if there is no model.
+void LOTPortDriver::selectGroup(const LOTSystemModel* model, std::list<std::string>& comms_list, std::list<std::string>& hardware_list)
+{
+	if (model == NULL)
+	{
+		errlogSevPrintf(errlogMajor, "LOT: %s: cannot tell which items are in comms group %d, using all of them\n", portName, m_group);
+		return;
+	}
+	int group = m_group;
+	auto other_group = [model, group](const std::string& id) {
+		const LOTSystemItem* item = model->find(id);
+		return (item != NULL && item->group != group);
+	};
+	comms_list.remove_if(other_group);
+	hardware_list.remove_if(other_group);
+	if (comms_list.empty())
+	{
+		errlogSevPrintf(errlogMajor, "LOT: %s: system model has no comms object in group %d\n", portName, m_group);
+	}
+}
+
+/// Compare the hardware the SDK enumerated, and the number of grating and filter positions of each item, with
+/// \a model, which is what LOTMakeSubstitutions generates the substitutions from, and report any difference
+void LOTPortDriver::checkSystemModel(const std::string& config_file, const LOTSystemModel& model)
+{
+	int differences = 0;
+	auto count = [this](const std::string& id, int token) {
+		int n = 0;
+		for (auto p = m_layout.params.cbegin(); p != m_layout.params.cend(); ++p)
+		{
+			n += (p->id == id && p->token == token ? 1 : 0);
+		}
+		return n;
+	};
+	for (auto it = m_layout.items.cbegin(); it != m_layout.items.cend(); ++it)
+	{
+		const LOTSystemItem* item = model.find(it->id);
+		if (item == NULL || item->type != it->type)
+		{
+			errlogSevPrintf(errlogMinor, "LOT: %s: SDK item %s of type %d is %s in the system model as parsed\n", portName, it->id.c_str(),
+				it->type, (item == NULL ? "missing" : "of another type"));
+			++differences;
+			continue;
+		}
+		int n = 0;
+		if (it->type == lotMono)
+		{
+			n = static_cast<int>(item->value(TurretNumGratings, 0, std::max(item->max_index(GratingSwitchWL), 1)));
+		}
+		else if (it->type == lotFilterWheel)
+		{
+			n = static_cast<int>(item->value(FWheelPositions, 0, item->max_index(FWheelFilter)));
+		}
+		int sdk_n = count(it->id, (it->type == lotMono ? GratingSwitchWL : FWheelFilter));
+		if (n != sdk_n)
+		{
+			errlogSevPrintf(errlogMinor, "LOT: %s: SDK item %s has %d %s, the system model as parsed %d\n", portName, it->id.c_str(),
+				sdk_n, (it->type == lotMono ? "gratings" : "filter positions"), n);
+			++differences;
+		}
+	}
+	for (auto h = model.hardware().cbegin(); h != model.hardware().cend(); ++h)
+	{
+		bool found = false;
+		for (auto it = m_layout.items.cbegin(); it != m_layout.items.cend() && !found; ++it)
+		{
+			found = (it->id == h->id);
+		}
+		if (!found && (m_group == 0 || h->group == m_group))
+		{
+			errlogSevPrintf(errlogMinor, "LOT: %s: system model item %s was not found by the SDK\n", portName, h->id.c_str());
+			++differences;
+		}
+	}
+	if (differences != 0 || !model.warnings().empty())
+	{
+		errlogSevPrintf(errlogMinor, "LOT: %s: LOTMakeSubstitutions would not generate the same substitutions from \"%s\"\n", portName,
+			config_file.c_str());
+	}
+}
+
+/// Save the layout with the values of the static parameters to \a file, keyed on \a hash
+void LOTPortDriver::saveLayout(const std::string& file, const std::string& hash)
+{
+	lock();
+	for (size_t k = 0; k < m_layout.params.size() && k < m_lot_params.size(); ++k)
+	{
+		const LOTParam& lp = m_lot_params[k];
+		LOTLayout::Param& p = m_layout.params[k];
+		// SimulationMode is static as far as polling goes, but is set by LOTConfigure() rather than the system model
+		p.has_value = (lp.pollClass() == LOTParam::PollStatic && lp.token() != LOTTokens::SimulationMode && lp.hasValue() && lp.readOK());
+		if (p.has_value && p.is_string)
+		{
+			getStringParam(lp.id(), p.str);
+		}
+		else if (p.has_value)
+		{
+			getDoubleParam(lp.id(), &p.value);
+		}
+	}
+	unlock();
+	m_layout.save(file, hash);
+}
+
+/// Read the parameters that are fixed by the system model and not already known from the layout cache; they are
+/// not polled again once read.
+void LOTPortDriver::readStaticValues()
+{
+	lock();
+	for (auto it = m_lot_params.begin(); it != m_lot_params.end(); ++it)
+	{
+		if (it->pollClass() == LOTParam::PollStatic && !it->hasValue() && fetchParam(&*it) && !it->readOK())
+		{
+			std::cerr << "LOT: unable to read " << it->name() << ": " << it->readError() << std::endl;
+		}
+	}
+	publishFamilies();
+	callParamCallbacks();
+	unlock();
+}
+
+/// Poll the LOTParam::PollFast parameters, and the LOTParam::PollSlow ones if \a include_slow.
+/// Static parameters whose initial read failed are retried with the slow ones. A failed read leaves the
+/// last value published and its error is kept for readParam() to return to clients.
+///
+/// The SDK is read by m_poll_requests on the SDK thread without the port lock, so writes can go in between;
+/// the port is then locked once to publish the values and call callParamCallbacks().
+///
+/// A parameter that fails m_breaker_failures times in a row has its circuit breaker opened by recordRead() and is
+/// left out of the sweeps, other than one read every m_breaker_retry seconds, until it reads again.
+///
+/// The poll list and requests are reused from sweep to sweep, so once every parameter has been read, and each
+/// SDK error seen once, a sweep makes no heap allocation; a read that fails only counts the error.
+void LOTPortDriver::updateValues(bool include_slow)
+{
+	epicsTimeStamp start;
+	epicsTimeGetCurrent(&start);
+	lock();
+	if (!m_connected)
+	{
+		unlock();
+		return;
+	}
+	m_poll_list.clear();
+	for (size_t i = 0; i < m_lot_params.size(); ++i)
+	{
+		const LOTParam& lp = m_lot_params[i];
+		if (lp.breakerHolds(start))
+		{
+			continue;
+		}
+		if (lp.pollClass() == LOTParam::PollFast || (include_slow && (lp.pollClass() == LOTParam::PollSlow || !lp.hasValue())))
+		{
+			m_poll_list.push_back(i);
+		}
+	}
+	if (m_poll_requests.size() < m_lot_params.size())
+	{
+		while (m_poll_requests.size() < m_lot_params.size())
+		{
+			m_poll_requests.push_back(std::unique_ptr<LOTFetchRequest>(new LOTFetchRequest(LOTSdkRequest::PriorityPoll)));
+		}
+		m_sdk.reserve(2 * m_lot_params.size() + 8, m_group); // a poll and a write for every parameter, and a few one-off calls
+	}
+	for (size_t k = 0; k < m_poll_list.size(); ++k)
+	{
+		LOTFetchRequest* req = m_poll_requests[m_poll_list[k]].get();
+		req->param = &m_lot_params[m_poll_list[k]];
+		req->setMaxAge(m_slow_period); // a poll that has waited this long has been overtaken by the next sweep
+		req->comms_lost = &m_sweep_comms_lost;
+	}
+	m_sweep_comms_lost = false;
+	unlock();
+	for (size_t k = 0; k < m_poll_list.size(); ++k)
+	{
+		sdkSubmit(m_poll_requests[m_poll_list[k]].get());
+	}
+	for (size_t k = 0; k < m_poll_list.size(); ++k)
+	{
+		m_sdk.wait(m_poll_requests[m_poll_list[k]].get());
+	}
+	epicsTimeStamp now;
+	epicsTimeGetCurrent(&now);
+	lock();
+	bool sweep_ok = true;
+	const LOTFetchRequest* lost = NULL;
+	m_sweep_reads = 0;
+	for (size_t k = 0; k < m_poll_list.size(); ++k)
+	{
+		const LOTFetchRequest* req = m_poll_requests[m_poll_list[k]].get();
+		LOTParam& lp = m_lot_params[m_poll_list[k]];
+		if (req->skipped() || req->abandoned)
+		{
+			continue;
+		}
+		if (req->reading.error.ok())
+		{
+			countRead(lp.publish(req->reading));
+		}
+		else
+		{
+			sweep_ok = false;
+			if (lost == NULL && LOTUtils::comms_lost(req->reading.error.code))
+			{
+				lost = req;
+			}
+		}
+		recordRead(lp, now, req->reading);
+		++m_sweep_reads;
+	}
+	m_sweep_stats.add(epicsTimeDiffInSeconds(&now, &start), sweep_ok);
+	if (lost != NULL)
+	{
+		commsLost(lost->reading.error.message());
+	}
+	publishWriteResults();
+	publishFamilies();
+	if (include_slow || !moving())
+	{
+		publishHistory(); // while moving, the changes are left to be fetched together at the end
+	}
+	if (include_slow)
+	{
+		setIntegerParam(P_suppressed, static_cast<int>(m_suppressed));
+		publishDiagnostics();
+	}
+	callParamCallbacks();
+	if (moving())
+	{
+		m_poll_period = m_min_period;
+	}
+	else if (m_poll_period < m_fast_period)
+	{
+		m_poll_period = (2.0 * m_poll_period < m_fast_period ? 2.0 * m_poll_period : m_fast_period); // decay back to the idle rate
+	}
+	else
+	{
+		m_poll_period = m_fast_period;
+	}
+	unlock();
+}
+
+/// Record that a move has been requested and wake the poller so it switches to the fast rate; called with the port locked.
+void LOTPortDriver::noteMove()
+{
+	epicsTimeGetCurrent(&m_last_move);
+	m_poll_period = m_min_period;
+	m_poll_event.signal();
+}
+
+/// A move is in progress if one was requested less than m_settle_time ago, or a wavelength readback is not yet at the setpoint.
+bool LOTPortDriver::moving()
+{
+	epicsTimeStamp now;
+	epicsTimeGetCurrent(&now);
+	if (moveInProgress() || epicsTimeDiffInSeconds(&now, &m_last_move) < m_settle_time)
+	{
+		return true;
+	}
+	for (auto it = m_wl_params.cbegin(); m_wl_setpoint_valid && it != m_wl_params.cend(); ++it)
+	{
+		const LOTParam& lp = m_lot_params[*it];
+		double wl;
+		if (lp.hasValue() && getDoubleParam(lp.id(), &wl) == asynSuccess && fabs(wl - m_wl_setpoint) > m_wl_tolerance)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Start a move to wavelength \a wl on the move thread and return its sequence number for waitMove(); called with the port locked.
+/// A move requested while another is in progress replaces any that has not yet started.
+unsigned LOTPortDriver::startMove(double wl)
+{
+	m_wl_setpoint = wl;
+	m_wl_setpoint_valid = true;
+	m_move_target = wl;
+	if (m_moves_started != m_moves_requested)
+	{
+		++m_writes_dropped; // the move thread has not yet picked up the previous target, and now never will
+		setIntegerParam(P_writesDropped, static_cast<int>(m_writes_dropped));
+	}
+	unsigned move = ++m_moves_requested;
+	setIntegerParam(P_moveBusy, 1);
+	setIntegerParam(P_moveDone, 0);
+	callParamCallbacks();
+	noteMove();
+	m_sdk.cancel(LOTSdkRequest::PriorityPoll); // queued polls would only run after the move, when their values are stale
+	m_move_request.signal();
+	return move;
+}
+
+/// Wait until move \a move, or a later one, has completed; returns false with the SDK error in \a error if it failed.
+bool LOTPortDriver::waitMove(unsigned move, std::string& error)
+{
+	while (!m_shutdown_requested)
+	{
+		lock();
+		if (static_cast<int>(m_moves_completed - move) >= 0)
+		{
+			error = m_move_error;
+			unlock();
+			return error.empty();
+		}
+		unlock();
+		m_move_done.wait(1.0);
+	}
+	error = "IOC shutting down";
+	return false;
+}
+
+void LOTPortDriver::moveTask(void* arg)
+{
+	LOTPortDriver* driver = (LOTPortDriver*)arg;
+	while (true)
+	{
+		driver->m_move_request.wait();
+		if (driver->m_shutdown_requested)
+		{
+			break;
+		}
+		driver->lock();
+		double wl = driver->m_move_target;
+		unsigned move = driver->m_moves_requested;
+		bool connected = driver->m_connected;
+		driver->m_moves_started = move;
+		driver->unlock();
+		std::string error;
+		int code = LOT_OK;
+		epicsTimeStamp start, end;
+		epicsTimeGetCurrent(&start);
+		try
+		{
+			if (!connected)
+			{
+				driver->checkConnected();
+			}
+			driver->sdkCall([wl, &start, &code]() {
+				epicsTimeGetCurrent(&start); // time the SDK call, not the wait for the SDK thread
+				try
+				{
+					LOTUtils::select_wavelength(wl);
+				}
+				catch (const LOTException& ex)
+				{
+					code = ex.errcode(); // sdkCall() rethrows only the message
+					throw;
+				}
+			});
+		}
+		catch (const std::exception& ex)
+		{
+			error = ex.what();
+		}
+		epicsTimeGetCurrent(&end);
+		driver->lock();
+		if (connected)
+		{
+			driver->m_move_stats.add(epicsTimeDiffInSeconds(&end, &start), error.empty());
+		}
+		if (LOTUtils::comms_lost(code))
+		{
+			driver->commsLost(error);
+		}
+		driver->m_moves_completed = move;
+		driver->m_move_error = error;
+		if (move == driver->m_moves_requested)
+		{
+			driver->setIntegerParam(driver->P_moveBusy, 0);
+			driver->setIntegerParam(driver->P_moveDone, 1);
+		}
+		driver->setStringParam(driver->P_errMsg, error);
+		driver->noteMove();
+		driver->callParamCallbacks();
+		driver->unlock();
+		driver->m_move_done.signal();
+	}
+	driver->taskExited();
+}
+
+/// The wavelength last asked for, or failing that the first monochromator's readback; called with the port locked
+double LOTPortDriver::currentWavelength()
+{
+	double wl = 0.0;
+	if (m_wl_setpoint_valid)
+	{
+		wl = m_wl_setpoint;
+	}
+	else if (!m_wl_params.empty() && m_lot_params[m_wl_params[0]].hasValue())
+	{
+		getDoubleParam(m_lot_params[m_wl_params[0]].id(), &wl);
+	}
+	return wl;
+}
+
+/// Publish the hardware state the transition model predicts for \a wl, and the changes to get there; called with the port locked
+void LOTPortDriver::predict(double wl)
+{
+	setDoubleParam(P_predictWl, wl);
+	setIntegerParam(P_predictGrating, m_transitions.predictGrating(wl));
+	setIntegerParam(P_predictChanges, m_transitions.changes(currentWavelength(), wl));
+	setStringParam(P_predictState, m_transitions.describe(wl));
+	callParamCallbacks();
+}
+
+/// Fill the scan point list from SCANSTART to SCANSTOP in steps of SCANSTEP; called with the port locked.
+/// The list is left as it is while the step is zero or of the wrong sign, as it will be while the three are being set.
+void LOTPortDriver::generateScanPoints()
+{
+	double start, stop, step;
+	getDoubleParam(P_scanStart, &start);
+	getDoubleParam(P_scanStop, &stop);
+	getDoubleParam(P_scanStep, &step);
+	if (step == 0.0 || (stop - start) / step < 0.0)
+	{
+		return;
+	}
+	double n = floor((stop - start) / step + 1e-9) + 1.0;
+	if (n > MaxScanPoints)
+	{
+		throw std::runtime_error("scan would have more than " + std::to_string(MaxScanPoints) + " points");
+	}
+	m_scan_points.resize(static_cast<size_t>(n));
+	for (size_t i = 0; i < m_scan_points.size(); ++i)
+	{
+		m_scan_points[i] = start + static_cast<double>(i) * step;
+	}
+	setIntegerParam(P_scanNpts, static_cast<int>(m_scan_points.size()));
+	callParamCallbacks();
+	doCallbacksFloat64Array(m_scan_points.data(), m_scan_points.size(), P_scanPoints, 0);
+}
+
+/// Start a scan of the current point list on the scan thread; called with the port locked
+void LOTPortDriver::startScan()
+{
+	if (m_scan_busy)
+	{
+		throw std::runtime_error("scan already in progress");
+	}
+	if (m_scan_points.empty())
+	{
+		throw std::runtime_error("no scan points");
+	}
+	if (m_wl_params.empty())
+	{
+		throw std::runtime_error("no monochromator wavelength readback to scan");
+	}
+	int reorder = 0;
+	getIntegerParam(P_scanOrder, &reorder);
+	if (reorder != 0)
+	{
+		double from = currentWavelength();
+		int before = m_transitions.changes(m_scan_points, from);
+		int after = m_transitions.order(m_scan_points, from);
+		std::cerr << "LOT: scan reordered from " << before << " to " << after << " grating, filter and SAM changes" << std::endl;
+		doCallbacksFloat64Array(m_scan_points.data(), m_scan_points.size(), P_scanPoints, 0);
+	}
+	m_scan_busy = true;
+	m_scan_abort = false;
+	while (m_scan_wakeup.tryWait()) // e.g. from an abort that landed while the last scan was waiting for a move
+	{
+	}
+	m_scan_actual.clear();
+	m_scan_times.clear();
+	setIntegerParam(P_scanBusy, 1);
+	setIntegerParam(P_scanProgress, 0);
+	setStringParam(P_scanStatus, "Running");
+	callParamCallbacks();
+	doCallbacksFloat64Array(m_scan_actual.data(), 0, P_scanActual, 0);
+	doCallbacksFloat64Array(m_scan_times.data(), 0, P_scanTimes, 0);
+	m_scan_request.signal();
+}
+
+/// Visit each point of the scan in turn: move there, wait for the wavelength readback to settle, record it and dwell.
+/// Each point is published as it settles, so a client can start an acquisition off SCANPROGRESS.
+void LOTPortDriver::runScan()
+{
+	double dwell, tolerance, timeout;
+	lock();
+	std::vector<epicsFloat64> points(m_scan_points); // so the list can be edited for the next scan while this one runs
+	LOTFetchRequest readback(LOTSdkRequest::PriorityRead);
+	readback.param = &m_lot_params[m_wl_params[0]];
+	getDoubleParam(P_scanDwell, &dwell);
+	getDoubleParam(P_scanTolerance, &tolerance);
+	getDoubleParam(P_scanTimeout, &timeout);
+	if (tolerance <= 0.0)
+	{
+		tolerance = m_wl_tolerance;
+	}
+	unlock();
+	std::cerr << "LOT: scanning " << points.size() << " points" << std::endl;
+	std::string status = "Done";
+	epicsTimeStamp start, now;
+	epicsTimeGetCurrent(&start);
+	try
+	{
+		for (size_t i = 0; i < points.size(); ++i)
+		{
+			lock();
+			bool abort = m_scan_abort;
+			unsigned move = (abort ? 0 : startMove(points[i]));
+			unlock();
+			if (abort)
+			{
+				throw std::runtime_error("Aborted");
+			}
+			std::string error;
+			if (!waitMove(move, error))
+			{
+				throw std::runtime_error(error);
+			}
+			lock();
+			bool overtaken = (m_moves_completed != move);
+			unlock();
+			if (overtaken)
+			{
+				throw std::runtime_error("interrupted by another wavelength move");
+			}
+			double actual = settleScanPoint(readback, points[i], tolerance, timeout);
+			epicsTimeGetCurrent(&now);
+			lock();
+			m_scan_actual.push_back(actual);
+			m_scan_times.push_back(epicsTimeDiffInSeconds(&now, &start));
+			setIntegerParam(P_scanProgress, static_cast<int>(i + 1));
+			doCallbacksFloat64Array(m_scan_actual.data(), m_scan_actual.size(), P_scanActual, 0);
+			doCallbacksFloat64Array(m_scan_times.data(), m_scan_times.size(), P_scanTimes, 0);
+			callParamCallbacks();
+			unlock();
+			if (dwell > 0.0)
+			{
+				m_scan_wakeup.wait(dwell);
+			}
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		status = ex.what();
+	}
+	epicsTimeGetCurrent(&now);
+	lock();
+	size_t visited = m_scan_actual.size();
+	m_scan_busy = false;
+	setIntegerParam(P_scanBusy, 0);
+	setIntegerParam(P_scanRun, 0);
+	setStringParam(P_scanStatus, status);
+	callParamCallbacks();
+	unlock();
+	std::cerr << "LOT: scan finished after " << visited << " of " << points.size() << " points in " <<
+		epicsTimeDiffInSeconds(&now, &start) << "s: " << status << std::endl;
+}
+
+/// Read the wavelength through \a readback until it is within \a tolerance of \a target and return it;
+/// throws if it has not settled within \a timeout seconds of the move completing, or the scan is aborted.
+double LOTPortDriver::settleScanPoint(LOTFetchRequest& readback, double target, double tolerance, double timeout)
+{
+	epicsTimeStamp start, now;
+	epicsTimeGetCurrent(&start);
+	while (true)
+	{
+		sdkSubmit(&readback);
+		m_sdk.wait(&readback);
+		epicsTimeGetCurrent(&now);
+		lock();
+		if (!readback.skipped())
+		{
+			if (readback.reading.error.ok())
+			{
+				countRead(readback.param->publish(readback.reading));
+			}
+			recordRead(*readback.param, now, readback.reading);
+			callParamCallbacks();
+		}
+		bool abort = m_scan_abort;
+		double min_period = m_min_period;
+		unlock();
+		if (abort)
+		{
+			throw std::runtime_error("Aborted");
+		}
+		if (!readback.skipped())
+		{
+			if (!readback.reading.error.ok())
+			{
+				throw std::runtime_error(readback.reading.error.message());
+			}
+			if (fabs(readback.reading.value - target) <= tolerance)
+			{
+				return readback.reading.value;
+			}
+		}
+		if (epicsTimeDiffInSeconds(&now, &start) > timeout)
+		{
+			throw std::runtime_error("wavelength did not settle within " + std::to_string(tolerance) + " of " + std::to_string(target));
+		}
+		m_scan_wakeup.wait(min_period);
+	}
+}
+
+void LOTPortDriver::scanTask(void* arg)
+{
+	LOTPortDriver* driver = (LOTPortDriver*)arg;
+	while (true)
+	{
+		driver->m_scan_request.wait();
+		if (driver->m_shutdown_requested)
+		{
+			break;
+		}
+		driver->runScan();
+	}
+	driver->taskExited();
+}
+
+/// Fit the zero order offsets of the points written to CALGRATING, CALNOMINAL and CALMEASURED; called with the port locked
+void LOTPortDriver::fitCalibration()
+{
+	if (m_cal_grating.size() != m_cal_nominal.size() || m_cal_grating.size() != m_cal_measured.size())
+	{
+		throw std::runtime_error("calibration point arrays differ in length");
+	}
+	m_calibration.clear();
+	for (size_t i = 0; i < m_cal_grating.size(); ++i)
+	{
+		m_calibration.addPoint(static_cast<int>(m_cal_grating[i]), m_cal_nominal[i], m_cal_measured[i]);
+	}
+	m_calibration.fit();
+	publishCalibration();
+}
+
+/// Recalibrate the gratings fitted by fitCalibration() in one SDK call, which either changes every zero order or none;
+/// called with the port locked
+void LOTPortDriver::applyCalibration()
+{
+	checkConnected();
+	if (moveInProgress() || m_scan_busy)
+	{
+		throw std::runtime_error("cannot recalibrate during a move or scan");
+	}
+	if (m_cal_mono.empty())
+	{
+		throw std::runtime_error("no monochromator to recalibrate");
+	}
+	try
+	{
+		sdkCall([this]() { m_calibration.apply(m_cal_mono); });
+	}
+	catch (const std::exception&)
+	{
+		setStringParam(P_calStatus, "Apply failed, zero orders unchanged");
+		callParamCallbacks();
+		throw;
+	}
+	std::cerr << "LOT: recalibrated " << m_cal_mono << "\n" << m_calibration.describe(true);
+	refreshAll(); // the current wavelength moves with the zero order of the current grating
+	publishCalibration();
+}
+
+/// Restore the zero orders from before the last applyCalibration() and save them to the SDK setup; called with the port locked
+void LOTPortDriver::rollbackCalibration()
+{
+	checkConnected();
+	if (moveInProgress() || m_scan_busy)
+	{
+		throw std::runtime_error("cannot recalibrate during a move or scan");
+	}
+	sdkCall([this]() { m_calibration.rollback(m_cal_mono); });
+	std::cerr << "LOT: calibration of " << m_cal_mono << " rolled back" << std::endl;
+	refreshAll();
+	publishCalibration();
+	setStringParam(P_calStatus, "Rolled back");
+	callParamCallbacks();
+}
+
+/// Publish the fits of m_calibration and the zero orders of the last ones applied
+void LOTPortDriver::publishCalibration()
+{
+	const std::vector<LOTCalibration::Fit>& fits = m_calibration.fits();
+	const std::vector<LOTCalibration::Fit>& applied = m_calibration.applied();
+	m_cal_fit_grating.clear();
+	m_cal_offset.clear();
+	m_cal_residual.clear();
+	double max_residual = 0.0;
+	for (auto f = fits.cbegin(); f != fits.cend(); ++f)
+	{
+		m_cal_fit_grating.push_back(f->grating);
+		m_cal_offset.push_back(f->offset);
+		m_cal_residual.push_back(f->residual);
+		max_residual = std::max(max_residual, f->residual);
+	}
+	m_cal_applied_grating.clear();
+	m_cal_old_zord.clear();
+	m_cal_new_zord.clear();
+	for (auto f = applied.cbegin(); f != applied.cend(); ++f)
+	{
+		m_cal_applied_grating.push_back(f->grating);
+		m_cal_old_zord.push_back(f->old_zord);
+		m_cal_new_zord.push_back(f->new_zord);
+	}
+	std::ostringstream status;
+	if (!applied.empty())
+	{
+		status << "Applied to " << applied.size() << " gratings";
+	}
+	else
+	{
+		status << "Fitted " << fits.size() << " gratings, largest residual " << max_residual << " nm";
+	}
+	setIntegerParam(P_calApplied, static_cast<int>(applied.size()));
+	setStringParam(P_calStatus, status.str());
+	callParamCallbacks();
+	doCallbacksFloat64Array(m_cal_fit_grating.data(), m_cal_fit_grating.size(), P_calFitGrating, 0);
+	doCallbacksFloat64Array(m_cal_offset.data(), m_cal_offset.size(), P_calOffset, 0);
+	doCallbacksFloat64Array(m_cal_residual.data(), m_cal_residual.size(), P_calResidual, 0);
+	doCallbacksFloat64Array(m_cal_applied_grating.data(), m_cal_applied_grating.size(), P_calAppliedGrating, 0);
+	doCallbacksFloat64Array(m_cal_old_zord.data(), m_cal_old_zord.size(), P_calOldZord, 0);
+	doCallbacksFloat64Array(m_cal_new_zord.data(), m_cal_new_zord.size(), P_calNewZord, 0);
+}
+
+/// Fit the calibration points in \a file, see LOTCalibration::load(), and if \a apply recalibrate the monochromator
+/// with them, as if they had been written to the CAL arrays followed by CALFIT and CALAPPLY
+void LOTPortDriver::calibrate(const std::string& file, bool apply)
+{
+	LOTCalibration points;
+	points.load(file);
+	if (points.points().size() > MaxCalPoints)
+	{
+		throw std::runtime_error("too many calibration points in \"" + file + "\"");
+	}
+	lock();
+	try
+	{
+		m_cal_grating.clear();
+		m_cal_nominal.clear();
+		m_cal_measured.clear();
+		for (auto p = points.points().cbegin(); p != points.points().cend(); ++p)
+		{
+			m_cal_grating.push_back(p->grating);
+			m_cal_nominal.push_back(p->nominal);
+			m_cal_measured.push_back(p->measured);
+		}
+		doCallbacksFloat64Array(m_cal_grating.data(), m_cal_grating.size(), P_calGrating, 0);
+		doCallbacksFloat64Array(m_cal_nominal.data(), m_cal_nominal.size(), P_calNominal, 0);
+		doCallbacksFloat64Array(m_cal_measured.data(), m_cal_measured.size(), P_calMeasured, 0);
+		fitCalibration();
+		std::cerr << m_calibration.describe();
+		if (apply)
+		{
+			applyCalibration();
+		}
+	}
+	catch (const std::exception&)
+	{
+		unlock();
+		throw;
+	}
+	unlock();
+}
+
+void LOTPortDriver::setCacheMaxAge(double max_age)
+{
+	lock();
+	m_cache_max_age = (max_age > 0.0 ? max_age : 0.0);
+	unlock();
+	std::cerr << "LOT: serving reads from values less than " << m_cache_max_age << "s old" << std::endl;
+}
+
+void LOTPortDriver::setMovePoll(double min_period, double settle_time, double tolerance)
+{
+	lock();
+	if (min_period > 0.0)
+	{
+		m_min_period = min_period;
+	}
+	if (settle_time >= 0.0)
+	{
+		m_settle_time = settle_time;
+	}
+	if (tolerance > 0.0)
+	{
+		m_wl_tolerance = tolerance;
+	}
+	unlock();
+	std::cerr << "LOT: polling every " << m_min_period << "s during moves, settled " << m_settle_time << "s after a move with wavelength within " << m_wl_tolerance << " of setpoint" << std::endl;
+}
+
+void LOTPortDriver::setPollPeriods(double fast_period, double slow_period)
+{
+	lock();
+	if (fast_period > 0.0)
+	{
+		m_fast_period = fast_period;
+	}
+	if (slow_period > 0.0)
+	{
+		m_slow_period = slow_period;
+	}
+	unlock();
+	std::cerr << "LOT: polling fast parameters every " << m_fast_period << "s and slow parameters every " << m_slow_period << "s" << std::endl;
+}
+
+/// Set the deadband of the parameters whose asyn name matches the glob \a pattern, returns the number changed
+int LOTPortDriver::setDeadband(const char* pattern, double abs_deadband, double rel_deadband)
+{
+	int n = 0;
+	lock();
+	for (auto it = m_lot_params.begin(); it != m_lot_params.end(); ++it)
+	{
+		if (epicsStrGlobMatch(it->name().c_str(), pattern))
+		{
+			it->setDeadband(abs_deadband, rel_deadband);
+			++n;
+		}
+	}
+	unlock();
+	std::cerr << "LOT: deadband abs=" << abs_deadband << " rel=" << rel_deadband << " set on " << n << " parameters matching \"" << pattern << "\"" << std::endl;
+	return n;
+}
+
+void LOTPortDriver::epicsExitFunc(void* arg)
+{
+	LOTPortDriver* driver = static_cast<LOTPortDriver*>(arg);
+	if (driver == NULL)
+	{
+		return;
+	}
+	driver->m_shutdown_requested = true;
+	driver->m_poll_event.signal();
+	driver->m_move_request.signal();
+	driver->m_move_done.signal();
+	driver->m_scan_abort = true;
+	driver->m_scan_request.signal();
+	driver->m_scan_wakeup.signal();
+	driver->m_sdk.cancel(LOTSdkRequest::PriorityWrite, driver->m_group);
+	// the SDK is closed by the last release(), so let the threads finish their SDK calls first
+	epicsTimeStamp start, now;
+	epicsTimeGetCurrent(&start);
+	while (true)
+	{
+		driver->lock();
+		int tasks = driver->m_tasks;
+		driver->unlock();
+		if (tasks == 0)
+		{
+			break;
+		}
+		epicsTimeGetCurrent(&now);
+		if (epicsTimeDiffInSeconds(&now, &start) > ExitTimeout)
+		{
+			errlogSevPrintf(errlogMajor, "LOT: %s: %d thread(s) still running after %.0f seconds at exit, their SDK calls will fail\n",
+				driver->portName, tasks, static_cast<double>(ExitTimeout));
+			break;
+		}
+		driver->m_task_exited.wait(1.0);
+	}
+	LOTSdkArbiter::instance().release(driver->portName);
+}
+
+/// Called by the poller, move and scan threads as they return, so that epicsExitFunc() can wait for them
+void LOTPortDriver::taskExited()
+{
+	lock();
+	--m_tasks;
+	unlock();
+	m_task_exited.signal();
+}
+
+void LOTPortDriver::setReconnect(double min_delay, double max_delay)
+{
+	lock();
+	if (min_delay > 0.0)
+	{
+		m_reconnect_min = min_delay;
+	}
+	m_reconnect_max = (max_delay > m_reconnect_min ? max_delay : m_reconnect_min);
+	unlock();
+	std::cerr << "LOT: retrying lost hardware after " << m_reconnect_min << "s, backing off to every " << m_reconnect_max << "s" << std::endl;
+}
+
+void LOTPortDriver::setBreaker(int max_failures, double retry_period)
+{
+	lock();
+	m_breaker_failures = (max_failures > 0 ? max_failures : 0);
+	if (retry_period > 0.0)
+	{
+		m_breaker_retry = retry_period;
+	}
+	unlock();
+	if (m_breaker_failures > 0)
+	{
+		std::cerr << "LOT: reading a parameter only every " << m_breaker_retry << "s after " << m_breaker_failures << " failures in a row" << std::endl;
+	}
+	else
+	{
+		std::cerr << "LOT: parameter circuit breakers disabled" << std::endl;
+	}
+}
+
+/// Throw if the hardware has been lost and not yet reopened, rather than making an SDK call that can only fail
+void LOTPortDriver::checkConnected() const
+{
+	if (!m_connected)
+	{
+		throw std::runtime_error("LOT hardware disconnected, reconnecting");
+	}
+}
+
+/// Publish the connection state, and give every hardware parameter a COMM alarm while disconnected so records show
+/// their values are stale; called with the port locked, the caller calls callParamCallbacks()
+void LOTPortDriver::setConnectionStatus()
+{
+	setIntegerParam(P_connected, (m_connected ? 1 : 0));
+	setIntegerParam(P_disconnects, static_cast<int>(m_disconnects));
+	for (auto it = m_lot_params.cbegin(); it != m_lot_params.cend(); ++it)
+	{
+		setParamAlarm(*it);
+	}
+}
+
+/// Give the parameter of \a lp a COMM alarm while the hardware is disconnected, or a READ alarm while its circuit
+/// breaker is open, as its value is then stale; called with the port locked
+void LOTPortDriver::setParamAlarm(const LOTParam& lp)
+{
+	if (!m_connected)
+	{
+		setParamStatus(lp.id(), asynDisconnected);
+		setParamAlarmStatus(lp.id(), COMM_ALARM);
+		setParamAlarmSeverity(lp.id(), INVALID_ALARM);
+	}
+	else if (lp.tripped())
+	{
+		setParamStatus(lp.id(), asynError);
+		setParamAlarmStatus(lp.id(), READ_ALARM);
+		setParamAlarmSeverity(lp.id(), INVALID_ALARM);
+	}
+	else
+	{
+		setParamStatus(lp.id(), asynSuccess);
+		setParamAlarmStatus(lp.id(), NO_ALARM);
+		setParamAlarmSeverity(lp.id(), NO_ALARM);
+	}
+}
+
+/// Record the outcome of a read made by fetch() at \a when in \a lp, its history and its circuit breaker, updating the
+/// parameter's alarm if the breaker opens or closes; called with the port locked
+void LOTPortDriver::recordRead(LOTParam& lp, const epicsTimeStamp& when, const LOTReading& reading)
+{
+	lp.readDone(when, reading);
+	size_t i = static_cast<size_t>(m_lot_index[lp.id()]);
+	if (reading.error.ok() && i < m_history_index.size() && m_history_index[i] != -1)
+	{
+		m_histories[m_history_index[i]].history.add(when, reading.value);
+	}
+	if (!lp.updateBreaker(when, reading.error, m_breaker_failures, m_breaker_retry))
+	{
+		return;
+	}
+	if (lp.tripped())
+	{
+		errlogSevPrintf(errlogMinor, "LOT: %s failed %d times in a row, now read only every %gs until it succeeds: %s\n",
+			lp.name().c_str(), lp.failures(), m_breaker_retry, reading.error.message().c_str());
+	}
+	else
+	{
+		errlogSevPrintf(errlogInfo, "LOT: %s is reading again\n", lp.name().c_str());
+	}
+	setParamAlarm(lp);
+}
+
+/// An SDK call failed with \a error, a code LOTUtils::comms_lost() says means the hardware has gone: stop polling,
+/// and have the poller call reconnect() after m_reconnect_min; called with the port locked
+void LOTPortDriver::commsLost(const std::string& error)
+{
+	if (!m_connected)
+	{
+		return;
+	}
+	m_connected = false;
+	++m_disconnects;
+	m_reconnect_failures = 0;
+	m_reconnect_delay = m_reconnect_min;
+	epicsTimeGetCurrent(&m_next_reconnect);
+	epicsTimeAddSeconds(&m_next_reconnect, m_reconnect_delay);
+	m_sdk.cancel(LOTSdkRequest::PriorityPoll);
+	errlogSevPrintf(errlogMajor, "LOT: %s: hardware lost (%s), polling stopped until it can be reopened\n", portName, error.c_str());
+	setStringParam(P_errMsg, error);
+	setConnectionStatus();
+	callParamCallbacks();
+	m_poll_event.signal();
+}
+
+/// Reopen the SDK through LOTSdkArbiter::reopen() once the hardware has been lost for m_reconnect_delay, doubling the
+/// delay up to m_reconnect_max each time it fails; if another port has reopened it meanwhile that is used instead.
+/// On success the parameters are re-read and polling resumes. Called by the poller without the port lock; returns the seconds until it is next due.
+double LOTPortDriver::reconnect()
+{
+	epicsTimeStamp now;
+	epicsTimeGetCurrent(&now);
+	lock();
+	double wait = epicsTimeDiffInSeconds(&m_next_reconnect, &now);
+	unlock();
+	if (wait > 0.0)
+	{
+		return wait;
+	}
+	std::string error;
+	try
+	{
+		LOTSdkArbiter::instance().reopen(m_sdk_generation);
+	}
+	catch (const std::exception& ex)
+	{
+		error = ex.what();
+	}
+	lock();
+	epicsTimeGetCurrent(&m_next_reconnect);
+	if (!error.empty())
+	{
+		++m_reconnect_failures;
+		m_reconnect_delay = (2.0 * m_reconnect_delay < m_reconnect_max ? 2.0 * m_reconnect_delay : m_reconnect_max);
+		epicsTimeAddSeconds(&m_next_reconnect, m_reconnect_delay);
+		errlogSevPrintf(errlogMinor, "LOT: %s: reconnect attempt %lu failed, next in %gs: %s\n", portName, m_reconnect_failures,
+			m_reconnect_delay, error.c_str());
+		unlock();
+		return m_reconnect_delay;
+	}
+	errlogSevPrintf(errlogInfo, "LOT: %s: hardware reopened after %lu failed attempts\n", portName, m_reconnect_failures);
+	m_connected = true;
+	setStringParam(P_errMsg, "");
+	setConnectionStatus();
+	refreshAll();
+	unlock();
+	return 0.0;
+}
+
+void LOTPortDriver::pollerTask(void* arg)
+{
+	LOTPortDriver* driver = (LOTPortDriver*)arg;
+	epicsTimeStamp now, last_slow;
+	epicsTimeGetCurrent(&last_slow);
+	bool include_slow = true;
+	while (!driver->m_shutdown_requested)
+	{
+		driver->lock();
+		bool connected = driver->m_connected;
+		driver->unlock();
+		if (!connected)
+		{
+			driver->m_poll_event.wait(driver->reconnect());
+			continue;
+		}
+		driver->updateValues(include_slow);
+		driver->lock(); // the periods are changed by moves and the iocsh setters on other threads
+		double poll_period = driver->m_poll_period;
+		double slow_period = driver->m_slow_period;
+		driver->unlock();
+		driver->m_poll_event.wait(poll_period);
+		epicsTimeGetCurrent(&now);
+		include_slow = (epicsTimeDiffInSeconds(&now, &last_slow) >= slow_period);
+		if (include_slow)
+		{
+			last_slow = now;
+		}
+	}
+	driver->taskExited();
+}
+
+extern "C" {
+
+	/// EPICS iocsh callable function to call constructor of NetShrVarInterface().
+	/// The function is registered via NetShrVarRegister().
+	///
+	/// @param[in] portName @copydoc initArg0
+	/// @param[in] configSection @copydoc initArg1
+	/// @param[in] configFile @copydoc initArg2
+	/// @param[in] pollPeriod @copydoc initArg3
+	/// @param[in] options @copydoc initArg4
+	/// @param[in] group @copydoc initArg5
+	int LOTConfigure(const char *portName, const char* configFile, const char* substFile, int simulate, int options, int group)
+	{
+		try
+		{
+			LOTPortDriver* pd = new LOTPortDriver(portName, configFile, substFile, (simulate != 0), options, group);
+			return(asynSuccess);
+		}
+		catch (const std::exception& ex)
+		{
+			errlogSevPrintf(errlogFatal, "LOTConfigure failed: %s\n", ex.what());
+			return(asynError);
+		}
+	}
 
 	// EPICS iocsh shell commands 
 
@@ -592,23 +2467,278 @@ extern "C" {
 	static const iocshArg initArg1 = { "configFile", iocshArgString };		///< Path to the XML input file to load configuration information from
 	static const iocshArg initArg2 = { "substFile", iocshArgString };		///< Path to the XML input file to load configuration information from
 	static const iocshArg initArg3 = { "simulate", iocshArgInt };			///< poll period (ms) for BufferedReaders
+	static const iocshArg initArg4 = { "options", iocshArgInt };			///< bitmask of #LOTOptions, e.g. 1 to ignore the parameter layout cache, 2 for no per-index records
+	static const iocshArg initArg5 = { "group", iocshArgInt };			///< SDK comms group of the hardware this port drives, 0 for all of it
 
 	static const iocshArg * const initArgs[] = { &initArg0,
 		&initArg1,
 		&initArg2,
-		&initArg3 };
+		&initArg3,
+		&initArg4,
+		&initArg5 };
 
 	static const iocshFuncDef initFuncDef = { "LOTConfigure", sizeof(initArgs) / sizeof(iocshArg*), initArgs };
 
 	static void initCallFunc(const iocshArgBuf *args)
 	{
-		LOTConfigure(args[0].sval, args[1].sval, args[2].sval, args[3].ival);
+		LOTConfigure(args[0].sval, args[1].sval, args[2].sval, args[3].ival, args[4].ival, args[5].ival);
+	}
+
+	/// EPICS iocsh callable function to set the fast and slow poll periods of a LOTConfigure() port.
+	///
+	/// @param[in] portName @copydoc pollArg0
+	/// @param[in] fastPeriod @copydoc pollArg1
+	/// @param[in] slowPeriod @copydoc pollArg2
+	int LOTSetPollPeriods(const char *portName, double fastPeriod, double slowPeriod)
+	{
+		LOTPortDriver* driver = dynamic_cast<LOTPortDriver*>(reinterpret_cast<asynPortDriver*>(findAsynPortDriver(portName)));
+		if (driver == NULL)
+		{
+			errlogSevPrintf(errlogMajor, "LOTSetPollPeriods: unknown port \"%s\"\n", (portName != NULL ? portName : ""));
+			return(asynError);
+		}
+		driver->setPollPeriods(fastPeriod, slowPeriod);
+		return(asynSuccess);
+	}
+
+	static const iocshArg pollArg0 = { "portName", iocshArgString };			///< The name of the asyn driver port
+	static const iocshArg pollArg1 = { "fastPeriod", iocshArgDouble };		///< poll period (s) for fast changing parameters such as the current wavelength (default 0.5)
+	static const iocshArg pollArg2 = { "slowPeriod", iocshArgDouble };		///< poll period (s) for rarely changing parameters (default 5.0)
+
+	static const iocshArg * const pollArgs[] = { &pollArg0,
+		&pollArg1,
+		&pollArg2 };
+
+	static const iocshFuncDef pollFuncDef = { "LOTSetPollPeriods", sizeof(pollArgs) / sizeof(iocshArg*), pollArgs };
+
+	static void pollCallFunc(const iocshArgBuf *args)
+	{
+		LOTSetPollPeriods(args[0].sval, args[1].dval, args[2].dval);
+	}
+
+	/// EPICS iocsh callable function to configure fast polling of a LOTConfigure() port while a move is in progress.
+	/// The idle poll period is the fastPeriod of LOTSetPollPeriods().
+	///
+	/// @param[in] portName @copydoc moveArg0
+	/// @param[in] minPeriod @copydoc moveArg1
+	/// @param[in] settleTime @copydoc moveArg2
+	/// @param[in] tolerance @copydoc moveArg3
+	int LOTSetMovePoll(const char *portName, double minPeriod, double settleTime, double tolerance)
+	{
+		LOTPortDriver* driver = dynamic_cast<LOTPortDriver*>(reinterpret_cast<asynPortDriver*>(findAsynPortDriver(portName)));
+		if (driver == NULL)
+		{
+			errlogSevPrintf(errlogMajor, "LOTSetMovePoll: unknown port \"%s\"\n", (portName != NULL ? portName : ""));
+			return(asynError);
+		}
+		driver->setMovePoll(minPeriod, settleTime, tolerance);
+		return(asynSuccess);
+	}
+
+	static const iocshArg moveArg0 = { "portName", iocshArgString };			///< The name of the asyn driver port
+	static const iocshArg moveArg1 = { "minPeriod", iocshArgDouble };		///< poll period (s) while a move is in progress (default 0.05)
+	static const iocshArg moveArg2 = { "settleTime", iocshArgDouble };		///< time (s) after a move request to keep polling at minPeriod (default 2.0)
+	static const iocshArg moveArg3 = { "tolerance", iocshArgDouble };		///< wavelength readback within this of the setpoint counts as settled (default 0.01)
+
+	static const iocshArg * const moveArgs[] = { &moveArg0,
+		&moveArg1,
+		&moveArg2,
+		&moveArg3 };
+
+	static const iocshFuncDef moveFuncDef = { "LOTSetMovePoll", sizeof(moveArgs) / sizeof(iocshArg*), moveArgs };
+
+	static void moveCallFunc(const iocshArgBuf *args)
+	{
+		LOTSetMovePoll(args[0].sval, args[1].dval, args[2].dval, args[3].dval);
+	}
+
+	/// EPICS iocsh callable function to set how old a value read from the SDK can be and still be returned to a
+	/// record reading a LOTConfigure() port parameter; 0 reads from the SDK every time.
+	///
+	/// @param[in] portName @copydoc cacheArg0
+	/// @param[in] maxAge @copydoc cacheArg1
+	int LOTSetCacheMaxAge(const char *portName, double maxAge)
+	{
+		LOTPortDriver* driver = dynamic_cast<LOTPortDriver*>(reinterpret_cast<asynPortDriver*>(findAsynPortDriver(portName)));
+		if (driver == NULL)
+		{
+			errlogSevPrintf(errlogMajor, "LOTSetCacheMaxAge: unknown port \"%s\"\n", (portName != NULL ? portName : ""));
+			return(asynError);
+		}
+		driver->setCacheMaxAge(maxAge);
+		return(asynSuccess);
+	}
+
+	static const iocshArg cacheArg0 = { "portName", iocshArgString };			///< The name of the asyn driver port
+	static const iocshArg cacheArg1 = { "maxAge", iocshArgDouble };			///< maximum age (s) of a value returned without an SDK call (default 0.5)
+
+	static const iocshArg * const cacheArgs[] = { &cacheArg0,
+		&cacheArg1 };
+
+	static const iocshFuncDef cacheFuncDef = { "LOTSetCacheMaxAge", sizeof(cacheArgs) / sizeof(iocshArg*), cacheArgs };
+
+	static void cacheCallFunc(const iocshArgBuf *args)
+	{
+		LOTSetCacheMaxAge(args[0].sval, args[1].dval);
+	}
+
+	/// EPICS iocsh callable function to set how soon, and how often, a LOTConfigure() port tries to reopen the SDK after
+	/// a USB disconnect, comms error or IMAC timeout; the wait doubles after each failed attempt up to maxDelay.
+	///
+	/// @param[in] portName @copydoc reconnectArg0
+	/// @param[in] minDelay @copydoc reconnectArg1
+	/// @param[in] maxDelay @copydoc reconnectArg2
+	int LOTSetReconnect(const char *portName, double minDelay, double maxDelay)
+	{
+		LOTPortDriver* driver = dynamic_cast<LOTPortDriver*>(reinterpret_cast<asynPortDriver*>(findAsynPortDriver(portName)));
+		if (driver == NULL)
+		{
+			errlogSevPrintf(errlogMajor, "LOTSetReconnect: unknown port \"%s\"\n", (portName != NULL ? portName : ""));
+			return(asynError);
+		}
+		driver->setReconnect(minDelay, maxDelay);
+		return(asynSuccess);
+	}
+
+	static const iocshArg reconnectArg0 = { "portName", iocshArgString };		///< The name of the asyn driver port
+	static const iocshArg reconnectArg1 = { "minDelay", iocshArgDouble };		///< wait (s) before the first attempt to reopen the SDK (default 1.0)
+	static const iocshArg reconnectArg2 = { "maxDelay", iocshArgDouble };		///< longest wait (s) between attempts (default 60.0)
+
+	static const iocshArg * const reconnectArgs[] = { &reconnectArg0,
+		&reconnectArg1,
+		&reconnectArg2 };
+
+	static const iocshFuncDef reconnectFuncDef = { "LOTSetReconnect", sizeof(reconnectArgs) / sizeof(iocshArg*), reconnectArgs };
+
+	static void reconnectCallFunc(const iocshArgBuf *args)
+	{
+		LOTSetReconnect(args[0].sval, args[1].dval, args[2].dval);
+	}
+
+	/// EPICS iocsh callable function to set when a LOTConfigure() port stops polling a parameter whose reads keep
+	/// failing, e.g. a token the firmware does not support; it is then read once every retryPeriod until it succeeds.
+	///
+	/// @param[in] portName @copydoc breakerArg0
+	/// @param[in] maxFailures @copydoc breakerArg1
+	/// @param[in] retryPeriod @copydoc breakerArg2
+	int LOTSetBreaker(const char *portName, int maxFailures, double retryPeriod)
+	{
+		LOTPortDriver* driver = dynamic_cast<LOTPortDriver*>(reinterpret_cast<asynPortDriver*>(findAsynPortDriver(portName)));
+		if (driver == NULL)
+		{
+			errlogSevPrintf(errlogMajor, "LOTSetBreaker: unknown port \"%s\"\n", (portName != NULL ? portName : ""));
+			return(asynError);
+		}
+		driver->setBreaker(maxFailures, retryPeriod);
+		return(asynSuccess);
+	}
+
+	static const iocshArg breakerArg0 = { "portName", iocshArgString };		///< The name of the asyn driver port
+	static const iocshArg breakerArg1 = { "maxFailures", iocshArgInt };		///< consecutive failed reads after which a parameter is no longer polled, 0 to always poll (default 3)
+	static const iocshArg breakerArg2 = { "retryPeriod", iocshArgDouble };	///< time (s) between reads of a parameter that is no longer polled (default 60.0)
+
+	static const iocshArg * const breakerArgs[] = { &breakerArg0,
+		&breakerArg1,
+		&breakerArg2 };
+
+	static const iocshFuncDef breakerFuncDef = { "LOTSetBreaker", sizeof(breakerArgs) / sizeof(iocshArg*), breakerArgs };
+
+	static void breakerCallFunc(const iocshArgBuf *args)
+	{
+		LOTSetBreaker(args[0].sval, args[1].ival, args[2].dval);
+	}
+
+	/// EPICS iocsh callable function to set the change detection deadband of LOTConfigure() port parameters.
+	///
+	/// @param[in] portName @copydoc deadbandArg0
+	/// @param[in] paramPattern @copydoc deadbandArg1
+	/// @param[in] absDeadband @copydoc deadbandArg2
+	/// @param[in] relDeadband @copydoc deadbandArg3
+	int LOTSetDeadband(const char *portName, const char* paramPattern, double absDeadband, double relDeadband)
+	{
+		LOTPortDriver* driver = dynamic_cast<LOTPortDriver*>(reinterpret_cast<asynPortDriver*>(findAsynPortDriver(portName)));
+		if (driver == NULL)
+		{
+			errlogSevPrintf(errlogMajor, "LOTSetDeadband: unknown port \"%s\"\n", (portName != NULL ? portName : ""));
+			return(asynError);
+		}
+		if (driver->setDeadband((paramPattern != NULL ? paramPattern : "*"), absDeadband, relDeadband) == 0)
+		{
+			errlogSevPrintf(errlogMinor, "LOTSetDeadband: no parameters match \"%s\"\n", paramPattern);
+		}
+		return(asynSuccess);
+	}
+
+	static const iocshArg deadbandArg0 = { "portName", iocshArgString };		///< The name of the asyn driver port
+	static const iocshArg deadbandArg1 = { "paramPattern", iocshArgString };	///< glob pattern matched against asyn parameter names, e.g. mono1_MonochromatorCurrentWL or *_FWheel*
+	static const iocshArg deadbandArg2 = { "absDeadband", iocshArgDouble };	///< absolute change needed to publish a new reading
+	static const iocshArg deadbandArg3 = { "relDeadband", iocshArgDouble };	///< change relative to the last published reading needed to publish a new one
+
+	static const iocshArg * const deadbandArgs[] = { &deadbandArg0,
+		&deadbandArg1,
+		&deadbandArg2,
+		&deadbandArg3 };
+
+	static const iocshFuncDef deadbandFuncDef = { "LOTSetDeadband", sizeof(deadbandArgs) / sizeof(iocshArg*), deadbandArgs };
+
+	static void deadbandCallFunc(const iocshArgBuf *args)
+	{
+		LOTSetDeadband(args[0].sval, args[1].sval, args[2].dval, args[3].dval);
+	}
+
+	/// EPICS iocsh callable function to fit the zero order offsets of the gratings of a LOTConfigure() port's
+	/// monochromator to the reference lines in a file, and optionally recalibrate it with them. Each line of the file
+	/// is "grating nominal measured": a line at measured nm that the grating shows at nominal nm.
+	///
+	/// @param[in] portName @copydoc calibrateArg0
+	/// @param[in] pointsFile @copydoc calibrateArg1
+	/// @param[in] apply @copydoc calibrateArg2
+	int LOTCalibrate(const char *portName, const char* pointsFile, int apply)
+	{
+		LOTPortDriver* driver = dynamic_cast<LOTPortDriver*>(reinterpret_cast<asynPortDriver*>(findAsynPortDriver(portName)));
+		if (driver == NULL)
+		{
+			errlogSevPrintf(errlogMajor, "LOTCalibrate: unknown port \"%s\"\n", (portName != NULL ? portName : ""));
+			return(asynError);
+		}
+		try
+		{
+			driver->calibrate((pointsFile != NULL ? pointsFile : ""), (apply != 0));
+		}
+		catch (const std::exception& ex)
+		{
+			errlogSevPrintf(errlogMajor, "LOTCalibrate failed: %s\n", ex.what());
+			return(asynError);
+		}
+		return(asynSuccess);
+	}
+
+	static const iocshArg calibrateArg0 = { "portName", iocshArgString };		///< The name of the asyn driver port
+	static const iocshArg calibrateArg1 = { "pointsFile", iocshArgString };	///< file of "grating nominal measured" lines, # starts a comment
+	static const iocshArg calibrateArg2 = { "apply", iocshArgInt };			///< 1 to recalibrate with the fit, 0 to only print it
+
+	static const iocshArg * const calibrateArgs[] = { &calibrateArg0,
+		&calibrateArg1,
+		&calibrateArg2 };
+
+	static const iocshFuncDef calibrateFuncDef = { "LOTCalibrate", sizeof(calibrateArgs) / sizeof(iocshArg*), calibrateArgs };
+
+	static void calibrateCallFunc(const iocshArgBuf *args)
+	{
+		LOTCalibrate(args[0].sval, args[1].sval, args[2].ival);
 	}
 
 	/// Register new commands with EPICS IOC shell
 	static void LOTRegister(void)
 	{
 		iocshRegister(&initFuncDef, initCallFunc);
+		iocshRegister(&pollFuncDef, pollCallFunc);
+		iocshRegister(&deadbandFuncDef, deadbandCallFunc);
+		iocshRegister(&moveFuncDef, moveCallFunc);
+		iocshRegister(&cacheFuncDef, cacheCallFunc);
+		iocshRegister(&reconnectFuncDef, reconnectCallFunc);
+		iocshRegister(&breakerFuncDef, breakerCallFunc);
+		iocshRegister(&calibrateFuncDef, calibrateCallFunc);
 	}
 
 	epicsExportRegistrar(LOTRegister);
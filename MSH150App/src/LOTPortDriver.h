@@ -8,13 +8,66 @@
 #ifndef LOTPORTDRIVER_H
 #define LOTPORTDRIVER_H
 
-class LOTParam;
+class LOTMovePort;
+class LOTSystemModel;
+
+/// Reads one LOTParam on the SDK thread into a LOTReading, for the driver to publish afterwards
+struct LOTFetchRequest : public LOTSdkRequest
+{
+	LOTParam* param;
+	LOTReading reading;
+	bool* comms_lost; ///< if not NULL, set on an error that means the hardware has gone, and no read is attempted once it is
+	bool abandoned; ///< run() did not read as *comms_lost was already set
+	explicit LOTFetchRequest(Priority priority) : LOTSdkRequest(priority), param(NULL), comms_lost(NULL), abandoned(false) { }
+	void run()
+	{
+		abandoned = (comms_lost != NULL && *comms_lost);
+		if (abandoned)
+		{
+			return;
+		}
+		param->fetch(reading);
+		if (comms_lost != NULL && LOTUtils::comms_lost(reading.error.code))
+		{
+			*comms_lost = true;
+		}
+	}
+};
+
+/// Writes setpoints for one LOTParam on the SDK thread, keeping only the latest if they arrive faster than they can be sent
+class LOTWriteRequest : public LOTSdkRequest
+{
+public:
+	LOTParam* param;
+	LOTWriteRequest(LOTParam* p) : LOTSdkRequest(PriorityWrite), param(p), m_has_next(false), m_active(false), m_error_code(LOT_OK),
+		m_error_new(false) { }
+	bool post(const LOTReading& value, bool& dropped);
+	bool takeError(std::string& error, int& code);
+	void takeStats(LOTLatencyStats& stats);
+	void run();
+private:
+	epicsMutex m_lock; ///< protects the members below, shared between the port and SDK threads
+	LOTReading m_next; ///< setpoint waiting to be written
+	bool m_has_next;
+	bool m_active; ///< queued or running, so m_next will be picked up without submitting again
+	std::string m_error; ///< error from the last failed write
+	int m_error_code; ///< SDK error code of m_error, or LOT_Error if it was not an SDK error
+	bool m_error_new;
+	LOTLatencyStats m_stats; ///< writes made since the last takeStats()
+};
+
+/// Bits of the LOTConfigure() options argument
+enum LOTOptions
+{
+	LOTOptionForceEnumerate = 1, ///< enumerate the hardware and rewrite the substitutions file even if the layout cache matches
+	LOTOptionNoIndexedRecords = 2 ///< leave the records of each index of an indexed attribute out of the substitutions file, only its array
+};
 
 /// EPICS Asyn port driver class. 
 class LOTPortDriver : public asynPortDriver
 {
 public:
-	LOTPortDriver(const char *portName, const char* config_file, const char* subst_file, bool simulate);
+	LOTPortDriver(const char *portName, const char* config_file, const char* subst_file, bool simulate, int options = 0, int group = 0);
 
 	// These are the methods that we override from asynPortDriver
 	virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
@@ -22,16 +75,92 @@ public:
 	virtual asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t maxChars, size_t *nActual);
 	virtual asynStatus readFloat64(asynUser *pasynUser, epicsFloat64 *value);
 	virtual asynStatus readOctet(asynUser *pasynUser, char *value, size_t maxChars, size_t *nActual, int *eomReason);
+	virtual asynStatus writeFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements);
+	virtual asynStatus readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn);
 	virtual void report(FILE* fp, int details);
 	static void epicsExitFunc(void* arg);
-	void updateValues();
+	void taskExited();
+	void updateValues(bool include_slow = true);
+	void readStaticValues();
+	void setPollPeriods(double fast_period, double slow_period);
+	int setDeadband(const char* pattern, double abs_deadband, double rel_deadband);
+	void setMovePoll(double min_period, double settle_time, double tolerance);
+	void setCacheMaxAge(double max_age);
+	void setReconnect(double min_delay, double max_delay);
+	void setBreaker(int max_failures, double retry_period);
+	unsigned startMove(double wl);
+	bool waitMove(unsigned move, std::string& error);
+	void calibrate(const std::string& file, bool apply);
+	/// prediction of the hardware state for a wavelength, read only after construction so it can be used from any thread
+	const LOTTransitionModel& transitionModel() const { return m_transitions; }
 
-private:
+protected:
 
-	static void pollerTask(void* arg);
+	LOTParam* addParam(const std::string& id, int token, LOTParam::ParamType type, int index);
 	LOTParam* addRealParam(const std::string& id, int token, bool writable = false, int index = -1);
 	LOTParam* addStringParam(const std::string& id, int token, bool writable = false, int index = -1);
+
+	bool m_shutdown_requested;
+	enum { ExitTimeout = 30 }; ///< seconds epicsExitFunc() waits for the threads below before releasing the SDK anyway
+	int m_tasks; ///< poller, move and scan threads still running, under the port lock
+	epicsEvent m_task_exited; ///< signalled as each of them returns
+
+	std::vector<LOTParam> m_lot_params; ///< parameters in the order they were added, swept in this order by the poller
+	std::vector<int> m_lot_index; ///< index into m_lot_params of each asyn parameter id, -1 if it is not a LOTParam
+
+	/// the LOTParam for asyn parameter \a function, or NULL
+	LOTParam* findLOTParam(int function)
+	{
+		return (function >= 0 && function < static_cast<int>(m_lot_index.size()) && m_lot_index[function] != -1 ? &m_lot_params[m_lot_index[function]] : NULL);
+	}
+	std::fstream m_subst_file;
+	LOTLayout m_layout; ///< what addRealParam() and addStringParam() have been asked to add, saved as the layout cache
+	bool m_indexed_records; ///< write the substitutions of each index of an indexed attribute, not just of its array
+
+	/// the indices 1..n of an indexed SDK attribute, e.g. the FWheelFilter of each filter wheel position, which are
+	/// also published together as one asynFloat64Array parameter
+	struct ParamFamily
+	{
+		int asyn_id;
+		std::vector<size_t> members; ///< m_lot_params indices of index 1, 2, ...
+		std::vector<epicsFloat64> values; ///< as last published
+		bool published;
+	};
+	std::vector<ParamFamily> m_families;
+	void addFamilies();
+	void publishFamilies();
+	ParamFamily* findFamily(int function);
+
+	/// the recent changes of a LOTParam::PollFast parameter, published as asyn parameters named after it with
+	/// _HISTTIME, _HISTVALUE and _HISTSEQ appended
+	struct ParamHistory
+	{
+		size_t param; ///< index into m_lot_params
+		int time_id;
+		int value_id;
+		int seq_id;
+		LOTHistory history;
+	};
+	std::vector<ParamHistory> m_histories;
+	std::vector<int> m_history_index; ///< index into m_histories of each m_lot_params entry, -1 if it has no history
+	std::vector<epicsFloat64> m_history_times; ///< scratch for publishing a history without allocating
+	std::vector<epicsFloat64> m_history_values;
+	void addHistory(size_t param);
+	void publishHistory();
+	ParamHistory* findHistory(int function);
+
+private:
+
+	static void pollerTask(void* arg);
+	static void moveTask(void* arg);
+	static void scanTask(void* arg);
 	void addHardwareParams(const std::string& item);
+	double reconnect();
+	void commsLost(const std::string& error);
+	void checkConnected() const;
+	void setConnectionStatus();
+	void setParamAlarm(const LOTParam& lp);
+	void recordRead(LOTParam& lp, const epicsTimeStamp& when, const LOTReading& reading);
 
 	int P_configFile; // string
 	int P_saveSetup; // int
@@ -39,11 +168,185 @@ private:
 	int P_version; // string
 	int P_errMsg; // string
 	int P_c_group; // int
+	int P_suppressed; // int
+	int P_moveBusy; // int
+	int P_moveDone; // int
+	int P_refresh; // int
+	int P_writesDropped; // int
+	int P_scanPoints; // double array
+	int P_scanStart; // double
+	int P_scanStop; // double
+	int P_scanStep; // double
+	int P_scanNpts; // int
+	int P_scanDwell; // double
+	int P_scanTolerance; // double
+	int P_scanTimeout; // double
+	int P_scanRun; // int
+	int P_scanBusy; // int
+	int P_scanProgress; // int
+	int P_scanActual; // double array
+	int P_scanTimes; // double array
+	int P_scanStatus; // string
+	int P_scanOrder; // int
+	int P_predictWl; // double
+	int P_predictGrating; // int
+	int P_predictChanges; // int
+	int P_predictState; // string
+	int P_connected; // int
+	int P_disconnects; // int
+	int P_diagSweeps; // int
+	int P_diagSweepReads; // int
+	int P_diagSweepLast; // double, ms
+	int P_diagSweepMean; // double, ms
+	int P_diagSweepMax; // double, ms
+	int P_diagReads; // int
+	int P_diagReadErrors; // int
+	int P_diagReadMean; // double, ms
+	int P_diagReadMax; // double, ms
+	int P_diagReadHist; // double array
+	int P_diagWrites; // int
+	int P_diagWriteErrors; // int
+	int P_diagWriteMean; // double, ms
+	int P_diagWriteMax; // double, ms
+	int P_diagMoves; // int
+	int P_diagMoveErrors; // int
+	int P_diagMoveLast; // double, ms
+	int P_diagMoveMean; // double, ms
+	int P_diagMoveMax; // double, ms
+	int P_diagSlowest; // string
+	int P_diagSlowestMean; // double, ms
+	int P_diagReset; // int
+	int P_diagTripped; // int
+	int P_diagFailing; // int
+	int P_diagTrips; // int
+	int P_diagTrippedList; // string
+	int P_calGrating; // double array
+	int P_calNominal; // double array
+	int P_calMeasured; // double array
+	int P_calMono; // string
+	int P_calFit; // int
+	int P_calApply; // int
+	int P_calRollback; // int
+	int P_calFitGrating; // double array
+	int P_calOffset; // double array
+	int P_calResidual; // double array
+	int P_calApplied; // int
+	int P_calAppliedGrating; // double array
+	int P_calOldZord; // double array
+	int P_calNewZord; // double array
+	int P_calStatus; // string
 
-	static bool m_shutdown_requested;
+	void saveLayout(const std::string& file, const std::string& hash);
+	bool loadSystemModel(const std::string& config_file, LOTSystemModel& model);
+	void selectGroup(const LOTSystemModel* model, std::list<std::string>& comms_list, std::list<std::string>& hardware_list);
+	void checkSystemModel(const std::string& config_file, const LOTSystemModel& model);
+	void countRead(bool published);
+	void readParam(LOTParam* lp);
+	bool fetchParam(LOTParam* lp);
+	void refreshAll();
+	void postWrite(LOTParam* lp, const LOTReading& value);
+	void publishWriteResults();
+	void publishDiagnostics();
+	void resetDiagnostics();
+	void noteMove();
+	bool moving();
+	bool moveInProgress() const { return m_moves_completed != m_moves_requested; }
+	double currentWavelength();
+	void predict(double wl);
+	void generateScanPoints();
+	void startScan();
+	void runScan();
+	double settleScanPoint(LOTFetchRequest& readback, double target, double tolerance, double timeout);
+	void fitCalibration();
+	void applyCalibration();
+	void rollbackCalibration();
+	void publishCalibration();
 
-	std::map<int, LOTParam*> m_lot_params;
-	std::fstream m_subst_file;
+	/// run \a f on the SDK thread at write priority, in this port's comms group, and wait for it, rethrowing any error
+	template <typename F>
+	void sdkCall(const F& f) { m_sdk.call(LOTSdkRequest::PriorityWrite, f, m_group); }
+	/// queue \a req on the SDK thread to run in this port's comms group
+	void sdkSubmit(LOTSdkRequest* req)
+	{
+		req->setGroup(m_group);
+		m_sdk.submit(req);
+	}
+
+	LOTSdkQueue& m_sdk; ///< every SDK call after construction goes through this queue, shared by all ports, and its thread
+	unsigned m_sdk_generation; ///< the SDK as this port last opened it, see LOTSdkArbiter::reopen()
+	int m_group; ///< SDK comms group the calls of this port run in, 0 to leave the current one selected
+
+	bool m_connected; ///< false from an SDK comms error until reconnect() reopens the SDK; the hardware is not polled meanwhile
+	bool m_sweep_comms_lost; ///< set by the poll requests of a sweep on a comms error, so the rest of the sweep is not attempted
+	double m_reconnect_min; ///< seconds from losing the hardware to the first attempt to reopen the SDK
+	double m_reconnect_max; ///< longest wait between attempts, which doubles from m_reconnect_min after each failure
+	double m_reconnect_delay; ///< wait before the next attempt
+	epicsTimeStamp m_next_reconnect; ///< time of the next attempt
+	unsigned long m_disconnects; ///< times the hardware has been lost
+	unsigned long m_reconnect_failures; ///< failed attempts since it was last lost
+	int m_breaker_failures; ///< consecutive read failures that open a parameter's circuit breaker, 0 for never
+	double m_breaker_retry; ///< seconds between reads of a parameter while its breaker is open
+
+	double m_fast_period; ///< seconds between sweeps of LOTParam::PollFast parameters
+	double m_slow_period; ///< seconds between sweeps of LOTParam::PollSlow parameters
+	double m_min_period; ///< poll period while a move is in progress
+	double m_settle_time; ///< seconds after a move request during which the poll period is held at m_min_period
+	double m_wl_tolerance; ///< wavelength readback is considered settled when within this of the setpoint
+	double m_poll_period; ///< current period between fast sweeps, between m_min_period and m_fast_period
+	epicsEvent m_poll_event; ///< signalled to wake the poller early after a move request
+	std::vector<size_t> m_poll_list; ///< m_lot_params indices to read in the current poll sweep
+	std::vector<std::unique_ptr<LOTFetchRequest> > m_poll_requests; ///< reusable poll request for each m_lot_params index
+
+	unsigned long m_published; ///< readings that changed a parameter value
+	unsigned long m_suppressed; ///< readings not published as they were unchanged or within the deadband
+	double m_cache_max_age; ///< readFloat64() and readOctet() reuse a value read less than this many seconds ago
+	unsigned long m_cache_hits; ///< reads served from the parameter library without an SDK call
+	LOTFetchRequest m_read_request; ///< reusable request for reads on the port thread
+	std::vector<std::unique_ptr<LOTWriteRequest> > m_write_requests; ///< write slot for each m_lot_params index written so far, or NULL
+	unsigned long m_writes_dropped; ///< setpoints replaced by a later one before they were sent
+
+	LOTLatencyStats m_sweep_stats; ///< duration of each updateValues() sweep, an error if any read in it failed
+	int m_sweep_reads; ///< parameters read in the last sweep
+	LOTLatencyStats m_move_stats; ///< select_wavelength() calls
+	std::vector<epicsFloat64> m_diag_hist; ///< histogram of all parameter reads, published as DIAGREADHIST
+	std::string m_diag_tripped; ///< names of the parameters whose breaker is open, published as DIAGTRIPPEDLIST
+
+	LOTMovePort* m_move_port;
+	double m_wl_setpoint;
+	bool m_wl_setpoint_valid;
+	std::vector<size_t> m_wl_params; ///< m_lot_params indices of the MonochromatorCurrentWL readbacks compared against m_wl_setpoint
+	epicsTimeStamp m_last_move; ///< time of the last move request
+	epicsEvent m_move_request; ///< signalled to start a move to m_move_target
+	epicsEvent m_move_done; ///< signalled as each move completes
+	double m_move_target;
+	unsigned m_moves_requested; ///< sequence number of the last move requested
+	unsigned m_moves_started; ///< sequence number of the last move the move thread started
+	unsigned m_moves_completed; ///< sequence number of the last move completed
+	std::string m_move_error; ///< error from the last completed move, empty if it succeeded
+
+	LOTTransitionModel m_transitions;
+
+	enum { MaxScanPoints = 10000 }; ///< must not exceed NELM of the SCAN waveform records
+	std::vector<epicsFloat64> m_scan_points; ///< wavelengths the next scan will visit
+	std::vector<epicsFloat64> m_scan_actual; ///< settled wavelength readback at each point of the current or last scan
+	std::vector<epicsFloat64> m_scan_times; ///< seconds from the start of the scan at which each point settled
+	bool m_scan_busy;
+	bool m_scan_abort; ///< set to stop the scan at the next point, settle read or dwell
+	epicsEvent m_scan_request; ///< signalled to start a scan of m_scan_points
+	epicsEvent m_scan_wakeup; ///< signalled to end a settle or dwell wait early on abort
+
+	enum { MaxCalPoints = 100 }; ///< must not exceed NELM of the CAL waveform records
+	LOTCalibration m_calibration;
+	std::string m_cal_mono; ///< monochromator recalibrated, by default the first found
+	std::vector<epicsFloat64> m_cal_grating; ///< grating of each calibration point, as written to CALGRATING
+	std::vector<epicsFloat64> m_cal_nominal; ///< wavelength each point reads at, as written to CALNOMINAL
+	std::vector<epicsFloat64> m_cal_measured; ///< true wavelength of each point, as written to CALMEASURED
+	std::vector<epicsFloat64> m_cal_fit_grating; ///< the fits of m_calibration, published as arrays
+	std::vector<epicsFloat64> m_cal_offset;
+	std::vector<epicsFloat64> m_cal_residual;
+	std::vector<epicsFloat64> m_cal_applied_grating; ///< the last fits applied, until rolled back
+	std::vector<epicsFloat64> m_cal_old_zord;
+	std::vector<epicsFloat64> m_cal_new_zord;
 };
 
 #define P_configFileString 				"CONFIGFILE"
@@ -52,5 +355,72 @@ private:
 #define P_versionString 				"VERSION"
 #define P_errMsgString 					"ERRMSG"
 #define P_c_groupString 				"GROUP"
+#define P_suppressedString 				"SUPPRESSED"
+#define P_moveBusyString 				"MOVEBUSY"
+#define P_moveDoneString 				"MOVEDONE"
+#define P_refreshString 				"REFRESH"
+#define P_writesDroppedString 			"WRITESDROPPED"
+#define P_scanPointsString 				"SCANPOINTS"
+#define P_scanStartString 				"SCANSTART"
+#define P_scanStopString 				"SCANSTOP"
+#define P_scanStepString 				"SCANSTEP"
+#define P_scanNptsString 				"SCANNPTS"
+#define P_scanDwellString 				"SCANDWELL"
+#define P_scanToleranceString 			"SCANTOLERANCE"
+#define P_scanTimeoutString 			"SCANTIMEOUT"
+#define P_scanRunString 				"SCANRUN"
+#define P_scanBusyString 				"SCANBUSY"
+#define P_scanProgressString 			"SCANPROGRESS"
+#define P_scanActualString 				"SCANACTUAL"
+#define P_scanTimesString 				"SCANTIMES"
+#define P_scanStatusString 				"SCANSTATUS"
+#define P_scanOrderString 				"SCANORDER"
+#define P_predictWlString 				"PREDICTWL"
+#define P_predictGratingString 			"PREDICTGRATING"
+#define P_predictChangesString 			"PREDICTCHANGES"
+#define P_predictStateString 			"PREDICTSTATE"
+#define P_connectedString 				"CONNECTED"
+#define P_disconnectsString 			"DISCONNECTS"
+#define P_diagSweepsString 				"DIAGSWEEPS"
+#define P_diagSweepReadsString 			"DIAGSWEEPREADS"
+#define P_diagSweepLastString 			"DIAGSWEEPLAST"
+#define P_diagSweepMeanString 			"DIAGSWEEPMEAN"
+#define P_diagSweepMaxString 			"DIAGSWEEPMAX"
+#define P_diagReadsString 				"DIAGREADS"
+#define P_diagReadErrorsString 			"DIAGREADERRORS"
+#define P_diagReadMeanString 			"DIAGREADMEAN"
+#define P_diagReadMaxString 			"DIAGREADMAX"
+#define P_diagReadHistString 			"DIAGREADHIST"
+#define P_diagWritesString 				"DIAGWRITES"
+#define P_diagWriteErrorsString 		"DIAGWRITEERRORS"
+#define P_diagWriteMeanString 			"DIAGWRITEMEAN"
+#define P_diagWriteMaxString 			"DIAGWRITEMAX"
+#define P_diagMovesString 				"DIAGMOVES"
+#define P_diagMoveErrorsString 			"DIAGMOVEERRORS"
+#define P_diagMoveLastString 			"DIAGMOVELAST"
+#define P_diagMoveMeanString 			"DIAGMOVEMEAN"
+#define P_diagMoveMaxString 			"DIAGMOVEMAX"
+#define P_diagSlowestString 			"DIAGSLOWEST"
+#define P_diagSlowestMeanString 		"DIAGSLOWESTMEAN"
+#define P_diagResetString 				"DIAGRESET"
+#define P_diagTrippedString 			"DIAGTRIPPED"
+#define P_diagFailingString 			"DIAGFAILING"
+#define P_diagTripsString 				"DIAGTRIPS"
+#define P_diagTrippedListString 		"DIAGTRIPPEDLIST"
+#define P_calGratingString 				"CALGRATING"
+#define P_calNominalString 				"CALNOMINAL"
+#define P_calMeasuredString 			"CALMEASURED"
+#define P_calMonoString 				"CALMONO"
+#define P_calFitString 					"CALFIT"
+#define P_calApplyString 				"CALAPPLY"
+#define P_calRollbackString 			"CALROLLBACK"
+#define P_calFitGratingString 			"CALFITGRATING"
+#define P_calOffsetString 				"CALOFFSET"
+#define P_calResidualString 			"CALRESIDUAL"
+#define P_calAppliedString 				"CALAPPLIED"
+#define P_calAppliedGratingString 		"CALAPPLIEDGRATING"
+#define P_calOldZordString 				"CALOLDZORD"
+#define P_calNewZordString 				"CALNEWZORD"
+#define P_calStatusString 				"CALSTATUS"
 
 #endif /* LOTPORTDRIVER_H */
@@ -0,0 +1,157 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <string>
+#include <list>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsEvent.h>
+
+#include <epicsExport.h>
+
+#include "LOTUtils.h"
+#include "LOTSdkQueue.h"
+#include "LOTSdkArbiter.h"
+
+LOTSdkArbiter::LOTSdkArbiter() : m_simulate(false), m_generation(0)
+{
+}
+
+/// The arbiter of this process; it is never destroyed, as ports release it from their epicsAtExit() handlers
+LOTSdkArbiter& LOTSdkArbiter::instance()
+{
+	static LOTSdkArbiter* arbiter = new LOTSdkArbiter;
+	return *arbiter;
+}
+
+/// Open the SDK for \a port, building the system model from \a config_file, with every comms object in simulation
+/// mode if \a simulate, and initialising it if no other port has it open. Every port must use the same model, as the
+/// SDK holds only one. Returns the generation to pass to reopen().
+unsigned LOTSdkArbiter::open(const std::string& port, const std::string& config_file, bool simulate)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	if (!m_ports.empty())
+	{
+		if (config_file != m_config_file || simulate != m_simulate)
+		{
+			throw std::runtime_error("LOT SDK already open with system model \"" + m_config_file + "\"" +
+				(m_simulate ? " in simulation mode" : "") + " by port " + m_ports.front() + ", every port in an IOC must use the same one");
+		}
+		m_ports.push_back(port);
+		unsigned generation = 0;
+		m_queue.call(LOTSdkRequest::PriorityWrite, [this, &generation]() { generation = m_generation; });
+		return generation;
+	}
+	m_config_file = config_file;
+	m_simulate = simulate;
+	m_queue.setGroupSwitch(switchGroup);
+	m_queue.start("LOTSdkTask");
+	unsigned generation = 0;
+	try
+	{
+		m_queue.call(LOTSdkRequest::PriorityWrite, [this, &generation]() {
+			build();
+			generation = m_generation;
+		});
+	}
+	catch (const std::exception&)
+	{
+		m_queue.stop();
+		throw;
+	}
+	m_ports.push_back(port);
+	return generation;
+}
+
+/// Release the SDK opened by \a port, closing it if no other port has it open
+void LOTSdkArbiter::release(const std::string& port)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	std::list<std::string>::iterator it = std::find(m_ports.begin(), m_ports.end(), port);
+	if (it == m_ports.end())
+	{
+		return;
+	}
+	m_ports.erase(it);
+	if (!m_ports.empty())
+	{
+		return;
+	}
+	try
+	{
+		m_queue.call(LOTSdkRequest::PriorityClose, []() { LOTUtils::close(); });
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "LOT: close failed: " << ex.what() << std::endl;
+	}
+	m_queue.stop();
+}
+
+/// Close and rebuild the SDK after the hardware was lost in \a generation, unless another port has already done so
+/// since; either way \a generation is updated to the current one. Throws if the SDK cannot be reopened.
+void LOTSdkArbiter::reopen(unsigned& generation)
+{
+	m_queue.call(LOTSdkRequest::PriorityWrite, [this, &generation]() {
+		if (generation == m_generation)
+		{
+			try
+			{
+				LOTUtils::close();
+			}
+			catch (const std::exception&)
+			{
+				// expected while the hardware is away, the model is rebuilt regardless
+			}
+			build();
+			++m_generation;
+		}
+		generation = m_generation;
+	});
+}
+
+void LOTSdkArbiter::report(FILE* fp) const
+{
+	{
+		epicsGuard<epicsMutex> guard(m_lock);
+		fprintf(fp, "LOT: SDK open by %lu ports with system model \"%s\"%s\n", static_cast<unsigned long>(m_ports.size()),
+			m_config_file.c_str(), (m_simulate ? " in simulation mode" : ""));
+	}
+	m_queue.report(fp);
+}
+
+/// build_system_model(), put the comms objects in simulation mode if wanted and initialise(); on the SDK thread
+void LOTSdkArbiter::build()
+{
+	LOTUtils::build_system_model(m_config_file);
+	if (m_simulate)
+	{
+		std::list<std::string> comms_list;
+		LOTUtils::get_comms_list(comms_list);
+		for (std::list<std::string>::const_iterator c = comms_list.begin(); c != comms_list.end(); ++c)
+		{
+			LOTUtils::set(*c, LOTTokens::SimulationMode, -1, 1.0);
+		}
+	}
+	LOTUtils::initialise();
+	m_queue.resetGroup();
+}
+
+void LOTSdkArbiter::switchGroup(int group)
+{
+	LOTUtils::set_c_group(group);
+}
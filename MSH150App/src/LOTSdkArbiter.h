@@ -0,0 +1,39 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTSDKARBITER_H
+#define LOTSDKARBITER_H
+
+/// Owner of the LOT SDK for every LOTPortDriver in the IOC.
+///
+/// The SDK is a process wide singleton: one system model, one current comms group and calls that must not overlap.
+/// The arbiter builds and initialises it for the first port that opens it, closes it when the last one releases it,
+/// and runs the calls of all ports on its one LOTSdkQueue, selecting each request's comms group as it goes.
+class LOTSdkArbiter
+{
+public:
+	static LOTSdkArbiter& instance();
+	LOTSdkQueue& queue() { return m_queue; }
+	unsigned open(const std::string& port, const std::string& config_file, bool simulate);
+	void release(const std::string& port);
+	void reopen(unsigned& generation);
+	void report(FILE* fp) const;
+
+private:
+	LOTSdkArbiter();
+	void build();
+	static void switchGroup(int group);
+
+	mutable epicsMutex m_lock;
+	LOTSdkQueue m_queue;
+	std::list<std::string> m_ports; ///< ports that have the SDK open
+	std::string m_config_file;
+	bool m_simulate;
+	unsigned m_generation; ///< count of reopen()s that rebuilt the SDK; only used on the SDK thread
+};
+
+#endif /* LOTSDKARBITER_H */
@@ -0,0 +1,382 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsEvent.h>
+
+#include <epicsExport.h>
+
+#include "LOTSdkQueue.h"
+
+LOTSdkQueue::LOTSdkQueue() : m_queued(0), m_group_switch(NULL), m_group(0), m_batch(0), m_group_switches(0), m_seq(0), m_started(false), m_stop(false), m_thread(0), m_executed(0), m_stale(0), m_cancelled(0)
+{
+}
+
+LOTSdkQueue::~LOTSdkQueue()
+{
+	stop();
+}
+
+/// Start the worker thread; until then requests run on the calling thread, and after stop() they fail.
+void LOTSdkQueue::start(const char* thread_name)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	if (m_started)
+	{
+		return;
+	}
+	m_stop = false;
+	m_thread = epicsThreadCreate(thread_name,
+		epicsThreadPriorityMedium,
+		epicsThreadGetStackSize(epicsThreadStackMedium),
+		(EPICSTHREADFUNC)workerTask, this);
+	m_started = (m_thread != 0);
+}
+
+/// Cancel anything still queued, wait for the running request to finish and stop the worker thread.
+void LOTSdkQueue::stop()
+{
+	{
+		epicsGuard<epicsMutex> guard(m_lock);
+		if (!m_started || m_stop)
+		{
+			return;
+		}
+		m_stop = true;
+	}
+	m_work.signal();
+	if (!onWorker())
+	{
+		m_stopped.wait();
+	}
+}
+
+/// Set the function called to select the comms group of a request in a group other than the current one
+void LOTSdkQueue::setGroupSwitch(GroupSwitch group_switch)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	m_group_switch = group_switch;
+	m_group = 0;
+}
+
+/// Forget the current comms group, e.g. after the SDK has been reinitialised, so the next grouped request selects its own
+void LOTSdkQueue::resetGroup()
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	m_group = 0;
+}
+
+/// Queue \a req, which must not already be pending. It runs at once on this thread if the worker has not been started
+/// or this is the worker, and fails with an error without running once the queue has been stopped, as the SDK is
+/// closed then and its calls would no longer be serialised.
+void LOTSdkQueue::submit(LOTSdkRequest* req)
+{
+	{
+		epicsGuard<epicsMutex> guard(m_lock);
+		req->m_pending = true;
+		req->m_skipped = false;
+		req->m_error.clear();
+		if (m_stop && !onWorker())
+		{
+			req->m_error = "LOT SDK queue stopped";
+			++m_cancelled;
+			req->m_pending = false;
+			req->m_done.signal();
+			return;
+		}
+		if (m_started && !onWorker())
+		{
+			req->m_seq = ++m_seq;
+			epicsTimeGetCurrent(&req->m_queued);
+			Heap& heap = m_queues[req->m_group];
+			heap.push_back(req);
+			std::push_heap(heap.begin(), heap.end(), later);
+			++m_queued;
+			m_work.signal();
+			return;
+		}
+	}
+	if (switchGroup(req))
+	{
+		try
+		{
+			req->run();
+		}
+		catch (const std::exception& ex)
+		{
+			req->m_error = ex.what();
+		}
+	}
+	complete(req, false);
+}
+
+/// Wait until \a req is no longer pending; once this returns the worker has finished with it, so it may be destroyed
+void LOTSdkQueue::wait(LOTSdkRequest* req)
+{
+	while (true)
+	{
+		{
+			epicsGuard<epicsMutex> guard(m_lock);
+			if (!req->m_pending)
+			{
+				return;
+			}
+		}
+		req->m_done.wait();
+	}
+}
+
+/// submit() and wait() for \a req, rethrowing any error as std::runtime_error
+void LOTSdkQueue::execute(LOTSdkRequest* req)
+{
+	submit(req);
+	wait(req);
+	if (req->skipped())
+	{
+		throw std::runtime_error("LOT SDK request cancelled");
+	}
+	if (!req->error().empty())
+	{
+		throw std::runtime_error(req->error());
+	}
+}
+
+/// Remove queued requests of \a priority or lower before they run, only those for comms group \a group if it is
+/// not 0; returns the number removed
+int LOTSdkQueue::cancel(LOTSdkRequest::Priority priority, int group)
+{
+	std::vector<LOTSdkRequest*> removed;
+	{
+		epicsGuard<epicsMutex> guard(m_lock);
+		for (Queues::iterator q = m_queues.begin(); q != m_queues.end(); ++q)
+		{
+			if (group != 0 && q->first != group)
+			{
+				continue;
+			}
+			Heap& heap = q->second;
+			Heap::iterator it = std::partition(heap.begin(), heap.end(),
+				[priority](const LOTSdkRequest* r) { return r->priority() > priority; });
+			removed.insert(removed.end(), it, heap.end());
+			heap.erase(it, heap.end());
+			std::make_heap(heap.begin(), heap.end(), later);
+		}
+		m_queued -= removed.size();
+		m_cancelled += removed.size();
+	}
+	for (std::vector<LOTSdkRequest*>::iterator it = removed.begin(); it != removed.end(); ++it)
+	{
+		complete(*it, true);
+	}
+	return static_cast<int>(removed.size());
+}
+
+/// Make room for \a n requests for comms group \a group to be queued at once, so that submit() does not allocate
+void LOTSdkQueue::reserve(size_t n, int group)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	m_queues[group].reserve(n);
+}
+
+size_t LOTSdkQueue::queued() const
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	return m_queued;
+}
+
+void LOTSdkQueue::report(FILE* fp) const
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	fprintf(fp, "LOT: SDK queue %s, %lu queued, %lu run, %lu skipped as stale, %lu cancelled\n", (m_started && !m_stop ? "running" : "stopped"),
+		static_cast<unsigned long>(m_queued), m_executed, m_stale, m_cancelled);
+	if (m_group_switch != NULL)
+	{
+		fprintf(fp, "LOT: SDK comms group %d, %lu group switches\n", m_group, m_group_switches);
+	}
+}
+
+void LOTSdkQueue::workerTask(void* arg)
+{
+	static_cast<LOTSdkQueue*>(arg)->work();
+}
+
+void LOTSdkQueue::work()
+{
+	while (true)
+	{
+		LOTSdkRequest* req = NULL;
+		bool stale = false;
+		{
+			epicsGuard<epicsMutex> guard(m_lock);
+			if (m_stop)
+			{
+				break;
+			}
+			req = next();
+			if (req != NULL)
+			{
+				if (req->m_max_age > 0.0)
+				{
+					epicsTimeStamp now;
+					epicsTimeGetCurrent(&now);
+					stale = (epicsTimeDiffInSeconds(&now, &req->m_queued) > req->m_max_age);
+				}
+				if (stale)
+				{
+					++m_stale;
+				}
+				else
+				{
+					++m_executed;
+				}
+			}
+		}
+		if (req == NULL)
+		{
+			m_work.wait();
+			continue;
+		}
+		if (!stale && switchGroup(req))
+		{
+			try
+			{
+				req->run();
+			}
+			catch (const std::exception& ex)
+			{
+				req->m_error = ex.what();
+			}
+		}
+		complete(req, stale);
+	}
+	std::vector<LOTSdkRequest*> removed;
+	{
+		epicsGuard<epicsMutex> guard(m_lock);
+		for (Queues::iterator q = m_queues.begin(); q != m_queues.end(); ++q)
+		{
+			removed.insert(removed.end(), q->second.begin(), q->second.end());
+			q->second.clear();
+		}
+		m_queued = 0;
+		m_cancelled += removed.size();
+		m_started = false;
+	}
+	for (std::vector<LOTSdkRequest*>::iterator it = removed.begin(); it != removed.end(); ++it)
+	{
+		complete(*it, true);
+	}
+	m_stopped.signal();
+}
+
+/// Take the next request to run, with m_lock held, or return NULL if there is none.
+///
+/// This is the first by priority and then age across all groups, except that while the current group, or requests
+/// for any group, have one of the same priority it is taken instead, up to MaxBatch times in a row.
+LOTSdkRequest* LOTSdkQueue::next()
+{
+	Heap* best = NULL;
+	Heap* local = NULL;
+	for (Queues::iterator q = m_queues.begin(); q != m_queues.end(); ++q)
+	{
+		Heap& heap = q->second;
+		if (heap.empty())
+		{
+			continue;
+		}
+		if (best == NULL || later(best->front(), heap.front()))
+		{
+			best = &heap;
+		}
+		if ((q->first == 0 || q->first == m_group) && (local == NULL || later(local->front(), heap.front())))
+		{
+			local = &heap;
+		}
+	}
+	if (best == NULL)
+	{
+		return NULL;
+	}
+	if (local != NULL && local != best)
+	{
+		if (local->front()->m_priority == best->front()->m_priority && m_batch < MaxBatch)
+		{
+			++m_batch;
+			best = local;
+		}
+	}
+	std::pop_heap(best->begin(), best->end(), later);
+	LOTSdkRequest* req = best->back();
+	best->pop_back();
+	--m_queued;
+	return req;
+}
+
+/// Select the comms group of \a req if it is not the current one; on failure sets the error of \a req and returns false
+bool LOTSdkQueue::switchGroup(LOTSdkRequest* req)
+{
+	GroupSwitch group_switch;
+	{
+		epicsGuard<epicsMutex> guard(m_lock);
+		if (req->m_group == 0 || req->m_group == m_group || m_group_switch == NULL)
+		{
+			return true;
+		}
+		group_switch = m_group_switch;
+	}
+	try
+	{
+		group_switch(req->m_group);
+	}
+	catch (const std::exception& ex)
+	{
+		req->m_error = ex.what();
+		epicsGuard<epicsMutex> guard(m_lock);
+		m_group = 0;
+		return false;
+	}
+	epicsGuard<epicsMutex> guard(m_lock);
+	m_group = req->m_group;
+	m_batch = 0;
+	++m_group_switches;
+	return true;
+}
+
+bool LOTSdkQueue::onWorker() const
+{
+	return (m_thread != 0 && epicsThreadGetIdSelf() == m_thread);
+}
+
+/// Mark \a req done and wake its waiter. The signal is sent with m_lock held, as wait() returns as soon as it sees
+/// the request is not pending under m_lock, after which the caller may destroy it.
+void LOTSdkQueue::complete(LOTSdkRequest* req, bool skipped)
+{
+	epicsGuard<epicsMutex> guard(m_lock);
+	req->m_skipped = skipped;
+	req->m_pending = false;
+	req->m_done.signal();
+}
+
+/// heap ordering: true if \a a should run after \a b
+bool LOTSdkQueue::later(const LOTSdkRequest* a, const LOTSdkRequest* b)
+{
+	if (a->m_priority != b->m_priority)
+	{
+		return a->m_priority < b->m_priority;
+	}
+	return a->m_seq > b->m_seq;
+}
@@ -0,0 +1,123 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTSDKQUEUE_H
+#define LOTSDKQUEUE_H
+
+/// A unit of work for the LOTSdkQueue worker thread, owned by the caller and reusable once it is no longer pending().
+class LOTSdkRequest
+{
+public:
+	/// requests run highest priority first, and in submission order within a priority
+	enum Priority { PriorityPoll, PriorityRead, PriorityWrite, PriorityClose };
+	/// a request with \a max_age > 0 is skipped if it has been queued for longer than that many seconds
+	explicit LOTSdkRequest(Priority priority, double max_age = 0.0) : m_priority(priority), m_max_age(max_age), m_group(0), m_seq(0),
+		m_pending(false), m_skipped(false) { }
+	virtual ~LOTSdkRequest() { }
+	/// make the SDK call(s); runs on the worker thread, an exception is caught and kept in error()
+	virtual void run() = 0;
+	Priority priority() const { return m_priority; }
+	void setPriority(Priority priority) { m_priority = priority; }
+	void setMaxAge(double max_age) { m_max_age = max_age; }
+	int group() const { return m_group; }
+	/// run in SDK comms group \a group, or 0 for whichever group is current; not while pending()
+	void setGroup(int group) { m_group = group; }
+	bool pending() const { return m_pending; } ///< queued or running
+	bool skipped() const { return m_skipped; } ///< cancelled or stale, so run() was not called
+	const std::string& error() const { return m_error; }
+private:
+	friend class LOTSdkQueue;
+	Priority m_priority;
+	double m_max_age;
+	int m_group;
+	unsigned long m_seq;
+	epicsTimeStamp m_queued;
+	bool m_pending;
+	bool m_skipped;
+	std::string m_error;
+	epicsEvent m_done;
+};
+
+/// A request that runs a function object, for one-off synchronous calls with LOTSdkQueue::call()
+template <typename F>
+class LOTSdkCall : public LOTSdkRequest
+{
+public:
+	LOTSdkCall(Priority priority, const F& f, int group) : LOTSdkRequest(priority), m_f(f) { setGroup(group); }
+	void run() { m_f(); }
+private:
+	F m_f;
+};
+
+/// Serialises every call into the LOT SDK on one worker thread, taking queued requests in priority order.
+///
+/// Requests carry the SDK comms group they must run in, and the worker calls the group switch function set
+/// with setGroupSwitch() before one in another group. Among requests of the same priority it keeps to the current
+/// group while that has work, up to MaxBatch ahead of older requests for another group, so the requests of
+/// several ports sharing the SDK are batched rather than switching groups on every call.
+///
+/// A caller blocked in execute() or call() is waiting for its request to run, so the request may use state the
+/// caller has locked. The worker itself never takes the asyn port lock.
+class LOTSdkQueue
+{
+public:
+	/// selects SDK comms group \a group, throwing on failure; called on the worker thread
+	typedef void (*GroupSwitch)(int group);
+	LOTSdkQueue();
+	~LOTSdkQueue();
+	void start(const char* thread_name);
+	void stop();
+	void setGroupSwitch(GroupSwitch group_switch);
+	void resetGroup();
+	void submit(LOTSdkRequest* req);
+	void wait(LOTSdkRequest* req);
+	void execute(LOTSdkRequest* req);
+	/// run \a f on the worker thread at \a priority, in comms group \a group if not 0, and wait for it, rethrowing
+	/// any error as std::runtime_error
+	template <typename F>
+	void call(LOTSdkRequest::Priority priority, const F& f, int group = 0)
+	{
+		LOTSdkCall<F> req(priority, f, group);
+		execute(&req);
+	}
+	int cancel(LOTSdkRequest::Priority priority, int group = 0);
+	void reserve(size_t n, int group = 0);
+	size_t queued() const;
+	void report(FILE* fp) const;
+
+private:
+	enum { MaxBatch = 500 }; ///< requests taken from the current group ahead of older ones of the same priority for another
+	typedef std::vector<LOTSdkRequest*> Heap; ///< ordered by later()
+	typedef std::map<int, Heap> Queues;
+
+	static void workerTask(void* arg);
+	void work();
+	LOTSdkRequest* next();
+	bool switchGroup(LOTSdkRequest* req);
+	bool onWorker() const;
+	void complete(LOTSdkRequest* req, bool skipped);
+	static bool later(const LOTSdkRequest* a, const LOTSdkRequest* b);
+
+	mutable epicsMutex m_lock;
+	epicsEvent m_work; ///< signalled when a request is queued, or to stop
+	epicsEvent m_stopped;
+	Queues m_queues; ///< requests waiting to run, by comms group, 0 for those that can run in any
+	size_t m_queued;
+	GroupSwitch m_group_switch;
+	int m_group; ///< comms group the SDK is in, 0 if not known
+	unsigned m_batch; ///< requests taken from m_group ahead of older ones since it was selected
+	unsigned long m_group_switches;
+	unsigned long m_seq;
+	bool m_started;
+	bool m_stop;
+	epicsThreadId m_thread;
+	unsigned long m_executed; ///< requests run
+	unsigned long m_stale; ///< requests skipped as older than their max age
+	unsigned long m_cancelled; ///< requests removed by cancel() or stop(), or refused after it
+};
+
+#endif /* LOTSDKQUEUE_H */
@@ -0,0 +1,153 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTSTATS_H
+#define LOTSTATS_H
+
+#include <math.h>
+#include <stdio.h>
+
+/// Latency statistics with a fixed histogram of power of two microsecond bins.
+///
+/// Bin i counts samples up to 2^i us (the last bin is open ended); there is no allocation after construction.
+class LOTLatencyStats
+{
+public:
+	enum { NBINS = 28 }; ///< top closed bin is 2^26 us, about 67 seconds
+
+	LOTLatencyStats() { reset(); }
+
+	void reset()
+	{
+		m_count = m_errors = 0;
+		m_last = m_sum = m_max = 0.0;
+		m_min = -1.0;
+		for (int i = 0; i < NBINS; ++i)
+		{
+			m_bins[i] = 0;
+		}
+	}
+
+	/// record a call that took \a seconds, \a ok false if it returned an error
+	void add(double seconds, bool ok = true)
+	{
+		++m_count;
+		if (!ok)
+		{
+			++m_errors;
+		}
+		m_last = seconds;
+		m_sum += seconds;
+		if (seconds > m_max)
+		{
+			m_max = seconds;
+		}
+		if (m_min < 0.0 || seconds < m_min)
+		{
+			m_min = seconds;
+		}
+		++m_bins[bin_of(seconds)];
+	}
+
+	/// add the samples recorded in \a other
+	void merge(const LOTLatencyStats& other)
+	{
+		if (other.m_count == 0)
+		{
+			return;
+		}
+		m_count += other.m_count;
+		m_errors += other.m_errors;
+		m_last = other.m_last;
+		m_sum += other.m_sum;
+		if (other.m_max > m_max)
+		{
+			m_max = other.m_max;
+		}
+		if (m_min < 0.0 || other.m_min < m_min)
+		{
+			m_min = other.m_min;
+		}
+		for (int i = 0; i < NBINS; ++i)
+		{
+			m_bins[i] += other.m_bins[i];
+		}
+	}
+
+	long count() const { return m_count; }
+	long errors() const { return m_errors; }
+	double last() const { return m_last; }
+	double max() const { return m_max; }
+	double min() const { return (m_min < 0.0 ? 0.0 : m_min); }
+	double mean() const { return (m_count > 0 ? m_sum / m_count : 0.0); }
+	double total() const { return m_sum; }
+	long bin(int i) const { return m_bins[i]; }
+
+	/// estimate of the \a p (0..1) quantile, taken as the upper edge of the bin it falls in and clamped to the observed range
+	double percentile(double p) const
+	{
+		long target = static_cast<long>(ceil(p * m_count)), n = 0;
+		for (int i = 0; i < NBINS && m_count > 0; ++i)
+		{
+			n += m_bins[i];
+			if (n >= target && n > 0)
+			{
+				double v = bin_upper(i);
+				return (v > m_max ? m_max : (v < min() ? min() : v));
+			}
+		}
+		return m_max;
+	}
+
+	/// upper edge of bin \a i in seconds
+	static double bin_upper(int i) { return ldexp(1.0e-6, i); }
+
+	static int bin_of(double seconds)
+	{
+		int i = 0;
+		while (i < NBINS - 1 && seconds > bin_upper(i))
+		{
+			++i;
+		}
+		return i;
+	}
+
+	/// comma separated histogram header, one column per bin
+	static void print_header(FILE* fp)
+	{
+		for (int i = 0; i < NBINS; ++i)
+		{
+			if (i < NBINS - 1)
+			{
+				fprintf(fp, "%sle_%.0fus", (i > 0 ? "," : ""), bin_upper(i) * 1.0e6);
+			}
+			else
+			{
+				fprintf(fp, ",gt_%.0fus", bin_upper(i - 1) * 1.0e6);
+			}
+		}
+	}
+
+	void print_bins(FILE* fp) const
+	{
+		for (int i = 0; i < NBINS; ++i)
+		{
+			fprintf(fp, "%s%ld", (i > 0 ? "," : ""), m_bins[i]);
+		}
+	}
+
+private:
+	long m_count;
+	long m_errors;
+	double m_last;
+	double m_sum;
+	double m_max;
+	double m_min;
+	long m_bins[NBINS];
+};
+
+#endif /* LOTSTATS_H */
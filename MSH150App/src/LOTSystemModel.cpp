@@ -0,0 +1,389 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <cstdlib>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+#include "LOTHW.h"
+
+#include <epicsExport.h>
+
+#include "LOTSystemModel.h"
+
+namespace pt = boost::property_tree;
+
+static const struct { int token; const char* name; } token_names[] =
+{
+	{ MonochromatorScanDirection, "MonochromatorScanDirection" },
+	{ MonochromatorCurrentWL, "MonochromatorCurrentWL" },
+	{ MonochromatorCurrentGrating, "MonochromatorCurrentGrating" },
+	{ MonochromatorInitialise, "MonochromatorInitialise" },
+	{ MonochromatorModeSwitchNum, "MonochromatorModeSwitchNum" },
+	{ MonochromatorModeSwitchState, "MonochromatorModeSwitchState" },
+	{ MonochromatorCanModeSwitch, "MonochromatorCanModeSwitch" },
+	{ MonochromatorAutoSelectWavelength, "MonochromatorAutoSelectWavelength" },
+	{ MonochromatorZordSwitchSAM, "MonochromatorZordSwitchSAM" },
+	{ MonochromatorNumTurrets, "MonochromatorNumTurrets" },
+	{ MonochromatorCosAlpha, "MonochromatorCosAlpha" },
+	{ TurretNumGratings, "TurretNumGratings" },
+	{ GratingDensity, "GratingDensity" },
+	{ GratingZord, "GratingZord" },
+	{ GratingAlpha, "GratingAlpha" },
+	{ GratingSwitchWL, "GratingSwitchWL" },
+	{ GratingBlaze, "GratingBlaze" },
+	{ FWheelFilter, "FWheelFilter" },
+	{ FWheelPositions, "FWheelPositions" },
+	{ FWheelCurrentPosition, "FWheelCurrentPosition" },
+	{ SAMInitialState, "SAMInitialState" },
+	{ SAMSwitchWL, "SAMSwitchWL" },
+	{ SAMState, "SAMState" },
+	{ SAMCurrentState, "SAMCurrentState" },
+	{ SAMDeflectName, "SAMDeflectName" },
+	{ SAMNoDeflectName, "SAMNoDeflectName" },
+	{ MVSSSwitchWL, "MVSSSwitchWL" },
+	{ MVSSWidth, "MVSSWidth" },
+	{ MVSSCurrentWidth, "MVSSCurrentWidth" },
+	{ MVSSConstantBandwidth, "MVSSConstantBandwidth" },
+	{ MVSSConstantwidth, "MVSSConstantwidth" },
+	{ MVSSSlitMode, "MVSSSlitMode" },
+	{ MVSSPosition, "MVSSPosition" },
+	{ MVSSCurrentBandwidth, "MVSSCurrentBandwidth" },
+	{ SimulationMode, "SimulationMode" },
+	{ lotSettleDelay, "lotSettleDelay" },
+	{ lotMoveWithWavelength, "lotMoveWithWavelength" },
+	{ lotDescriptor, "lotDescriptor" },
+	{ lotParkOffset, "lotParkOffset" },
+	{ lotProductName, "lotProductName" }
+};
+
+bool LOTSystemItem::has(int token, int index) const
+{
+	return values.find(key_t(token, index)) != values.end() || strings.find(key_t(token, index)) != strings.end();
+}
+
+double LOTSystemItem::value(int token, int index, double def) const
+{
+	std::map<key_t, double>::const_iterator it = values.find(key_t(token, index));
+	return (it != values.end() ? it->second : def);
+}
+
+int LOTSystemItem::max_index(int token) const
+{
+	int n = 0;
+	for (auto it = values.cbegin(); it != values.cend(); ++it)
+	{
+		if (it->first.first == token && it->first.second > n)
+		{
+			n = it->first.second;
+		}
+	}
+	return n;
+}
+
+int LOTSystemModel::token_from_name(const std::string& name)
+{
+	for (size_t i = 0; i < sizeof(token_names) / sizeof(token_names[0]); ++i)
+	{
+		if (boost::iequals(name, token_names[i].name))
+		{
+			return token_names[i].token;
+		}
+	}
+	return -1;
+}
+
+const char* LOTSystemModel::token_name(int token)
+{
+	for (size_t i = 0; i < sizeof(token_names) / sizeof(token_names[0]); ++i)
+	{
+		if (token_names[i].token == token)
+		{
+			return token_names[i].name;
+		}
+	}
+	return NULL;
+}
+
+bool LOTSystemModel::is_string_token(int token)
+{
+	return (token == lotDescriptor || token == lotProductName || token == SAMDeflectName || token == SAMNoDeflectName);
+}
+
+bool LOTSystemModel::is_indexed_token(int token)
+{
+	return ((token >= GratingDensity && token <= GratingBlaze) || token == FWheelFilter);
+}
+
+int LOTSystemModel::hardware_type_from_name(const std::string& name)
+{
+	std::string s = boost::to_lower_copy(name);
+	if (s.find("mono") != std::string::npos)
+	{
+		return lotMono;
+	}
+	else if (s.find("filter") != std::string::npos || s.find("fwheel") != std::string::npos)
+	{
+		return lotFilterWheel;
+	}
+	else if (s.find("sam") != std::string::npos)
+	{
+		return lotSAM;
+	}
+	else if (s.find("slit") != std::string::npos || s.find("mvss") != std::string::npos)
+	{
+		return lotSlit;
+	}
+	else if (s.find("interface") != std::string::npos)
+	{
+		return lotInterface;
+	}
+	return -1;
+}
+
+static bool isCommsName(const std::string& name)
+{
+	std::string s = boost::to_lower_copy(name);
+	return (s.find("comms") != std::string::npos || s.find("usb") != std::string::npos);
+}
+
+/// look up an XML attribute ignoring case
+static bool getAttr(const pt::ptree& node, const char* name, std::string& value)
+{
+	boost::optional<const pt::ptree&> attrs = node.get_child_optional("<xmlattr>");
+	if (!attrs)
+	{
+		return false;
+	}
+	for (auto a = attrs->begin(); a != attrs->end(); ++a)
+	{
+		if (boost::iequals(a->first, name))
+		{
+			value = boost::trim_copy(a->second.data());
+			return true;
+		}
+	}
+	return false;
+}
+
+static void setValue(LOTSystemItem& item, int token, int index, const std::string& value)
+{
+	if (LOTSystemModel::is_string_token(token))
+	{
+		item.strings[LOTSystemItem::key_t(token, index)] = value;
+	}
+	else
+	{
+		item.values[LOTSystemItem::key_t(token, index)] = atof(value.c_str());
+	}
+}
+
+namespace {
+
+	/// true if \a node has no child elements, only attributes, comments and text
+	bool isLeaf(const pt::ptree& node)
+	{
+		for (auto child = node.begin(); child != node.end(); ++child)
+		{
+			if (child->first != "<xmlattr>" && child->first != "<xmlcomment>")
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	struct Parser
+	{
+		std::vector<LOTSystemItem>& comms;
+		std::vector<LOTSystemItem>& hardware;
+		std::vector<std::string>& warnings;
+		Parser(std::vector<LOTSystemItem>& c, std::vector<LOTSystemItem>& h, std::vector<std::string>& w) : comms(c), hardware(h), warnings(w) { }
+
+		const std::string& ownerId(bool owner_is_comms, int owner) const
+		{
+			return (owner_is_comms ? comms[owner].id : hardware[owner].id);
+		}
+
+		/// walk \a node; \a owner is the index of the enclosing item in its list (-1 if none)
+		void walk(const pt::ptree& node, bool owner_is_comms, int owner, int group, const std::string& mono)
+		{
+			for (auto child = node.begin(); child != node.end(); ++child)
+			{
+				const std::string& key = child->first;
+				if (key == "<xmlattr>" || key == "<xmlcomment>")
+				{
+					continue;
+				}
+				std::string id, type_name, s;
+				int token = LOTSystemModel::token_from_name(key);
+				if (token != -1)
+				{
+					if (owner == -1)
+					{
+						warnings.push_back("<" + key + "> is not inside an item, ignored");
+						continue;
+					}
+					int index = (getAttr(child->second, "index", s) ? atoi(s.c_str()) : 0);
+					if (LOTSystemModel::is_indexed_token(token) && index < 1)
+					{
+						warnings.push_back("<" + key + "> of " + ownerId(owner_is_comms, owner) + " has no index, ignored");
+						continue;
+					}
+					if (!LOTSystemModel::is_indexed_token(token) && index != 0)
+					{
+						warnings.push_back("<" + key + "> of " + ownerId(owner_is_comms, owner) + " is not indexed, index " + s + " ignored");
+						index = 0;
+					}
+					if (!getAttr(child->second, "value", s))
+					{
+						s = boost::trim_copy(child->second.data());
+					}
+					setValue(owner_is_comms ? comms[owner] : hardware[owner], token, index, s);
+					continue;
+				}
+				if (!getAttr(child->second, "id", id))
+				{
+					if (isLeaf(child->second) && (owner != -1 || !boost::trim_copy(child->second.data()).empty()))
+					{
+						warnings.push_back("<" + key + ">" + (owner != -1 ? " of " + ownerId(owner_is_comms, owner) : std::string()) +
+							" is not an SDK attribute, ignored");
+					}
+					walk(child->second, owner_is_comms, owner, group, mono);
+					continue;
+				}
+				if (!getAttr(child->second, "type", type_name))
+				{
+					type_name = key;
+				}
+				LOTSystemItem item;
+				item.id = id;
+				if (isCommsName(type_name))
+				{
+					item.group = (getAttr(child->second, "group", s) ? atoi(s.c_str()) : static_cast<int>(comms.size()) + 1);
+					readAttributes(child->second, item);
+					comms.push_back(item);
+					walk(child->second, true, static_cast<int>(comms.size()) - 1, item.group, "");
+				}
+				else
+				{
+					int type = LOTSystemModel::hardware_type_from_name(type_name);
+					item.type = (type != -1 ? type : lotUnknown);
+					if (type == -1)
+					{
+						warnings.push_back("item " + id + " is of unknown hardware type \"" + type_name + "\", none of its parameters are generated");
+					}
+					item.group = group;
+					item.mono = mono;
+					readAttributes(child->second, item);
+					hardware.push_back(item);
+					walk(child->second, false, static_cast<int>(hardware.size()) - 1, group, (item.type == lotMono ? id : mono));
+				}
+			}
+		}
+
+		/// tokens given as XML attributes of the item element itself
+		static void readAttributes(const pt::ptree& node, LOTSystemItem& item)
+		{
+			boost::optional<const pt::ptree&> attrs = node.get_child_optional("<xmlattr>");
+			if (!attrs)
+			{
+				return;
+			}
+			for (auto a = attrs->begin(); a != attrs->end(); ++a)
+			{
+				int token = LOTSystemModel::token_from_name(a->first);
+				if (token != -1)
+				{
+					setValue(item, token, 0, boost::trim_copy(a->second.data()));
+				}
+			}
+		}
+	};
+
+}
+
+void LOTSystemModel::clear()
+{
+	m_comms.clear();
+	m_hardware.clear();
+	m_warnings.clear();
+}
+
+void LOTSystemModel::load(const std::string& xmlfile)
+{
+	pt::ptree tree;
+	try
+	{
+		pt::read_xml(xmlfile, tree, pt::xml_parser::trim_whitespace);
+	}
+	catch (const pt::xml_parser_error& ex)
+	{
+		throw std::runtime_error(std::string("LOTSystemModel: cannot parse \"") + xmlfile + "\": " + ex.what());
+	}
+	clear();
+	Parser parser(m_comms, m_hardware, m_warnings);
+	parser.walk(tree, false, -1, 1, "");
+	if (m_hardware.size() == 0)
+	{
+		throw std::runtime_error(std::string("LOTSystemModel: no hardware items found in \"") + xmlfile + "\"");
+	}
+}
+
+LOTSystemItem* LOTSystemModel::find(const std::string& id)
+{
+	return find(id.c_str());
+}
+
+const LOTSystemItem* LOTSystemModel::find(const std::string& id) const
+{
+	return find(id.c_str());
+}
+
+LOTSystemItem* LOTSystemModel::find(const char* id)
+{
+	return const_cast<LOTSystemItem*>(static_cast<const LOTSystemModel*>(this)->find(id));
+}
+
+/// the item or comms object \a id, or NULL; takes a C string so the simulated SDK calls do not allocate
+const LOTSystemItem* LOTSystemModel::find(const char* id) const
+{
+	for (auto it = m_hardware.cbegin(); it != m_hardware.cend(); ++it)
+	{
+		if (it->id == id)
+		{
+			return &(*it);
+		}
+	}
+	for (auto it = m_comms.cbegin(); it != m_comms.cend(); ++it)
+	{
+		if (it->id == id)
+		{
+			return &(*it);
+		}
+	}
+	return NULL;
+}
+
+void LOTSystemModel::mono_items(const std::string& mono_id, std::list<std::string>& items) const
+{
+	items.clear();
+	for (auto it = m_hardware.cbegin(); it != m_hardware.cend(); ++it)
+	{
+		if (it->mono == mono_id)
+		{
+			items.push_back(it->id);
+		}
+	}
+}
@@ -0,0 +1,80 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTSYSTEMMODEL_H
+#define LOTSYSTEMMODEL_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <utility>
+
+#include <shareLib.h>
+
+/// A comms object or hardware item read from a LOT system model XML file.
+struct epicsShareClass LOTSystemItem
+{
+	typedef std::pair<int, int> key_t; ///< (token, index)
+
+	std::string id;
+	int type;            ///< one of LOTHWTypes, or LOTSystemItem::Comms
+	int group;           ///< comms group the item belongs to
+	std::string mono;    ///< id of the owning monochromator, empty if none
+	std::map<key_t, double> values;
+	std::map<key_t, std::string> strings;
+
+	enum { Comms = -1 };
+
+	LOTSystemItem() : type(Comms), group(1) { }
+	bool has(int token, int index = 0) const;
+	double value(int token, int index = 0, double def = 0.0) const;
+	int max_index(int token) const; ///< highest index present for an indexed token, 0 if none
+};
+
+/// Device tree parsed directly from a LOT system model XML file, without the vendor SDK.
+///
+/// The parser is deliberately tolerant of layout: any element carrying an \a id attribute
+/// is an item, classified from its element name (or \a type attribute) as a comms object
+/// (\a comms, \a usb), \a monochromator, \a filterwheel, \a sam, \a slit/\a mvss or \a interface.
+/// Hardware nested inside a monochromator becomes one of its mono items, and hardware nested
+/// inside a comms object belongs to that comms group. Attribute values are given either as
+/// XML attributes or child elements named after the SDK token, e.g.
+/// \code <GratingSwitchWL index="2">800</GratingSwitchWL> \endcode
+/// Elements that are neither items nor tokens are treated as plain containers. As the vendor schema is not published,
+/// anything the parser cannot place, e.g. an item of unknown type or a leaf element that is not a token, is recorded in
+/// warnings(), so that a model read incompletely does not go unnoticed.
+class epicsShareClass LOTSystemModel
+{
+public:
+	/// Parse \a xmlfile, replacing any current contents. Throws std::runtime_error on failure.
+	void load(const std::string& xmlfile);
+	void clear();
+
+	const std::vector<LOTSystemItem>& comms() const { return m_comms; }
+	const std::vector<LOTSystemItem>& hardware() const { return m_hardware; }
+	LOTSystemItem* find(const std::string& id);
+	const LOTSystemItem* find(const std::string& id) const;
+	LOTSystemItem* find(const char* id);
+	const LOTSystemItem* find(const char* id) const;
+	void mono_items(const std::string& mono_id, std::list<std::string>& items) const;
+	/// what load() ignored or could not classify
+	const std::vector<std::string>& warnings() const { return m_warnings; }
+
+	static int token_from_name(const std::string& name); ///< -1 if not a token name
+	static const char* token_name(int token);           ///< NULL if unknown
+	static bool is_string_token(int token);
+	static bool is_indexed_token(int token);
+	static int hardware_type_from_name(const std::string& name); ///< -1 if not hardware
+
+private:
+	std::vector<LOTSystemItem> m_comms;
+	std::vector<LOTSystemItem> m_hardware;
+	std::vector<std::string> m_warnings;
+};
+
+#endif /* LOTSYSTEMMODEL_H */
@@ -0,0 +1,208 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <string>
+#include <sstream>
+#include <list>
+#include <functional>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include <epicsExport.h>
+
+#include "LOTUtils.h"
+#include "LOTTransitionModel.h"
+
+/// Read \a token of \a id from the SDK, or return \a def if the item does not have it; must be called on the SDK thread
+double LOTTransitionModel::sdkValue(const std::string& id, int token, int index, double def)
+{
+	double d = def;
+	try
+	{
+		LOTUtils::get(id, token, index, d);
+	}
+	catch (const std::exception&)
+	{
+		d = def;
+	}
+	return d;
+}
+
+/// Read the switch wavelengths of hardware item \a id of LOTHWTypes \a hardware_type through \a getOr, if it is one
+/// select_wavelength() moves.
+void LOTTransitionModel::addItem(const std::string& id, int hardware_type, const Getter& getOr)
+{
+	Item item;
+	item.id = id;
+	item.type = hardware_type;
+	switch (hardware_type)
+	{
+	case lotMono:
+	{
+		item.moves = (getOr(id, MonochromatorAutoSelectWavelength, 0, 1.0) != 0.0);
+		item.fixed = static_cast<int>(getOr(id, MonochromatorCurrentGrating, 0, 1.0));
+		int n = static_cast<int>(getOr(id, TurretNumGratings, 0, 0.0));
+		for (int i = 1; i <= n; ++i)
+		{
+			item.switch_wl.push_back(getOr(id, GratingSwitchWL, i, -1.0));
+		}
+		m_items.push_back(item);
+		break;
+	}
+	case lotFilterWheel:
+	{
+		item.moves = (getOr(id, lotMoveWithWavelength, 0, 1.0) != 0.0);
+		item.fixed = static_cast<int>(getOr(id, FWheelCurrentPosition, 0, 1.0));
+		int n = static_cast<int>(getOr(id, FWheelPositions, 0, 0.0));
+		for (int i = 1; i <= n; ++i)
+		{
+			item.switch_wl.push_back(getOr(id, FWheelFilter, i, -1.0));
+		}
+		m_items.push_back(item);
+		break;
+	}
+	case lotSAM:
+	{
+		double switch_wl = getOr(id, SAMSwitchWL, 0, -1.0);
+		item.moves = (switch_wl > 0.0 && getOr(id, lotMoveWithWavelength, 0, 1.0) != 0.0); // a SAM without a switch wavelength stays put
+		item.fixed = static_cast<int>(getOr(id, SAMInitialState, 0, 0.0));
+		item.switch_wl.push_back(switch_wl);
+		m_items.push_back(item);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/// The grating or filter position, or SAM state, of item \a i at wavelength \a wl
+int LOTTransitionModel::predict(size_t i, double wl) const
+{
+	const Item& item = m_items[i];
+	if (!item.moves)
+	{
+		return item.fixed;
+	}
+	if (item.type == lotSAM)
+	{
+		return (wl >= item.switch_wl[0] ? 1 - item.fixed : item.fixed);
+	}
+	int selected = 1;
+	for (size_t k = 0; k < item.switch_wl.size(); ++k)
+	{
+		if (item.switch_wl[k] >= 0.0 && item.switch_wl[k] <= wl)
+		{
+			selected = static_cast<int>(k + 1);
+		}
+	}
+	return selected;
+}
+
+/// The grating the first monochromator will use at \a wl, or 0 if there is no monochromator
+int LOTTransitionModel::predictGrating(double wl) const
+{
+	for (size_t i = 0; i < m_items.size(); ++i)
+	{
+		if (m_items[i].type == lotMono)
+		{
+			return predict(i, wl);
+		}
+	}
+	return 0;
+}
+
+/// The number of gratings, filters and SAMs that change moving from \a from to \a to
+int LOTTransitionModel::changes(double from, double to) const
+{
+	int n = 0;
+	for (size_t i = 0; i < m_items.size(); ++i)
+	{
+		if (predict(i, from) != predict(i, to))
+		{
+			++n;
+		}
+	}
+	return n;
+}
+
+/// The number of gratings, filters and SAMs that change visiting \a wl in order, starting at \a from
+int LOTTransitionModel::changes(const std::vector<double>& wl, double from) const
+{
+	int n = 0;
+	for (size_t k = 0; k < wl.size(); ++k)
+	{
+		n += changes(k > 0 ? wl[k - 1] : from, wl[k]);
+	}
+	return n;
+}
+
+/// Order \a a and \a b by the state of each item in turn, taking a SAM as deflected or not, so that
+/// wavelengths needing the same hardware state compare equal; returns <0, 0 or >0 like strcmp().
+int LOTTransitionModel::compare(double a, double b) const
+{
+	for (size_t i = 0; i < m_items.size(); ++i)
+	{
+		int sa = predict(i, a), sb = predict(i, b);
+		if (m_items[i].type == lotSAM && m_items[i].fixed != 0)
+		{
+			sa = 1 - sa;
+			sb = 1 - sb;
+		}
+		if (sa != sb)
+		{
+			return sa - sb;
+		}
+	}
+	return 0;
+}
+
+/// Reorder \a wl so each grating, filter and SAM change happens as few times as possible, starting from \a from.
+///
+/// Wavelengths that need the same hardware state are grouped together in their original order, and the groups are
+/// visited in wavelength order, up or down, whichever changes less from \a from. As each item's position is a step
+/// function of wavelength, no order can change any item fewer times. Returns the number of changes in the new order.
+int LOTTransitionModel::order(std::vector<double>& wl, double from) const
+{
+	std::vector<double> up(wl);
+	std::stable_sort(up.begin(), up.end(), [this](double a, double b) { return compare(a, b) < 0; });
+	std::vector<double> down;
+	down.reserve(up.size());
+	size_t end = up.size();
+	while (end > 0)
+	{
+		size_t begin = end - 1;
+		while (begin > 0 && compare(up[begin - 1], up[end - 1]) == 0)
+		{
+			--begin;
+		}
+		down.insert(down.end(), up.begin() + begin, up.begin() + end);
+		end = begin;
+	}
+	int n_up = changes(up, from), n_down = changes(down, from);
+	if (n_down < n_up)
+	{
+		wl.swap(down);
+		return n_down;
+	}
+	wl.swap(up);
+	return n_up;
+}
+
+/// e.g. "mono1 grating 2, fwheel1 filter 3, sam1 state 1"
+std::string LOTTransitionModel::describe(double wl) const
+{
+	std::ostringstream oss;
+	for (size_t i = 0; i < m_items.size(); ++i)
+	{
+		const char* what = (m_items[i].type == lotMono ? "grating" : (m_items[i].type == lotFilterWheel ? "filter" : "state"));
+		oss << (i > 0 ? ", " : "") << m_items[i].id << " " << what << " " << predict(i, wl);
+	}
+	return oss.str();
+}
@@ -0,0 +1,49 @@
+/*************************************************************************\
+* Copyright (c) 2013 Science and Technology Facilities Council (STFC), GB.
+* All rights reverved.
+* This file is distributed subject to a Software License Agreement found
+* in the file LICENSE.txt that is included with this distribution.
+\*************************************************************************/
+
+#ifndef LOTTRANSITIONMODEL_H
+#define LOTTRANSITIONMODEL_H
+
+/// Predicts the grating, filter position and SAM state LOTUtils::select_wavelength() will choose for a wavelength.
+///
+/// Built once from the switch wavelengths in the SDK by addItem(), after which it is read only and can be queried from any
+/// thread without touching the hardware. Each item's position is a step function of wavelength: the highest
+/// position whose switch wavelength is at or below it, and for a SAM the deflected state from SAMSwitchWL up.
+class LOTTransitionModel
+{
+public:
+	/// an item that select_wavelength() may move
+	struct Item
+	{
+		std::string id;
+		int type; ///< lotMono, lotFilterWheel or lotSAM
+		bool moves; ///< false if the item stays where it is, e.g. a filter wheel without lotMoveWithWavelength
+		int fixed; ///< position or state while !moves
+		std::vector<double> switch_wl; ///< switch wavelength of position i + 1, or the SAMSwitchWL of a SAM
+	};
+
+	/// reads SDK attribute (id, token, index), returning the default given if the item does not have it
+	typedef std::function<double(const std::string&, int, int, double)> Getter;
+
+	LOTTransitionModel() { }
+	void addItem(const std::string& id, int type, const Getter& get = sdkValue);
+	static double sdkValue(const std::string& id, int token, int index, double def);
+	size_t size() const { return m_items.size(); }
+	const Item& item(size_t i) const { return m_items[i]; }
+	int predict(size_t i, double wl) const;
+	int predictGrating(double wl) const;
+	int changes(double from, double to) const;
+	int changes(const std::vector<double>& wl, double from) const;
+	int order(std::vector<double>& wl, double from) const;
+	std::string describe(double wl) const;
+
+private:
+	std::vector<Item> m_items;
+	int compare(double a, double b) const;
+};
+
+#endif /* LOTTRANSITIONMODEL_H */
@@ -1,17 +1,25 @@
+#include <stdio.h>
 #include <string>
-#include <sstream>
 #include <list>
+#include <set>
+#include <map>
 #include <exception>
-#include <iostream>
+#include <stdexcept>
 #include <boost/algorithm/string.hpp>
 
-#include "LOTHw.h"
+#include "LOTHW.h"
+
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <epicsStdio.h>
 
 #include <epicsExport.h>
 
 #include "LOTUtils.h"
 
-#define BUFFER_SIZE 256
+#define BUFFER_SIZE LOT_BUFFER_SIZE
 
 static const char* lookupError(int code)
 {
@@ -96,29 +104,129 @@ std::string LOTException::lotErrMsg() const
 	return lookupError(m_errcode);
 }
 
+namespace {
+
+	/// occurrences of one (id, error code) pair, and when it was last logged
+	struct ErrorCount
+	{
+		unsigned long count;
+		unsigned long logged; ///< count when last logged
+		epicsTimeStamp last_log;
+	};
+
+	typedef std::map<std::pair<const char*, int>, ErrorCount> ErrorCounts; ///< keyed on interned id and error code
+
+	const double error_log_interval = 60.0; ///< seconds between repeat log messages for the same id and error code
+
+	epicsMutex& errorLock()
+	{
+		static epicsMutex lock;
+		return lock;
+	}
+
+	ErrorCounts& errorCounts()
+	{
+		static ErrorCounts counts;
+		return counts;
+	}
+
+	unsigned long error_total = 0;
+
+	/// Count \a error from SDK call \a function and log it through errlog, the first time it is seen for its id and
+	/// error code and then at most once every error_log_interval with the number of repeats; a repeat costs only
+	/// a counter increment, so a device that has gone away does not flood the console from every poll.
+	void countError(const char* function, const LOTError& error)
+	{
+		epicsTimeStamp now;
+		epicsTimeGetCurrent(&now);
+		unsigned long repeats;
+		{
+			epicsGuard<epicsMutex> guard(errorLock());
+			ErrorCount& ec = errorCounts()[std::make_pair(error.id, error.code)];
+			++error_total;
+			if (++ec.count > 1 && epicsTimeDiffInSeconds(&now, &ec.last_log) < error_log_interval)
+			{
+				return;
+			}
+			repeats = ec.count - ec.logged;
+			ec.logged = ec.count;
+			ec.last_log = now;
+		}
+		if (repeats == 1)
+		{
+			errlogSevPrintf(errlogMinor, "LOT: %s: id='%s' error=%d (%s) address=%d\n", function, (error.id != NULL ? error.id : ""),
+				error.code, lookupError(error.code), error.address);
+		}
+		else
+		{
+			errlogSevPrintf(errlogMinor, "LOT: %s: id='%s' error=%d (%s) %lu more times since last reported\n", function,
+				(error.id != NULL ? error.id : ""), error.code, lookupError(error.code), repeats);
+		}
+	}
+
+	/// Count and log the error from SDK call \a function, which returned \a rc, and throw it as a LOTException
+	void throwError(int rc, const char* function)
+	{
+		LOTError error;
+		char myid[BUFFER_SIZE];
+		myid[0] = myid[sizeof(myid) - 1] = '\0';
+		bool known = (LOT_get_last_error(&error.code, myid, &error.address) == LOT_OK);
+		myid[sizeof(myid) - 1] = '\0';
+		if (!known)
+		{
+			error.code = rc;
+			error.address = 0;
+			myid[0] = '\0';
+		}
+		error.id = LOTUtils::intern(myid);
+		countError(function, error);
+		throw LOTException((known ? error.message() : std::string("unknown error")), error.code, myid, error.address);
+	}
+
+	/// Fill in \a error for a call through \a h that returned \a rc, counting and logging it if it failed.
+	/// The SDK's own return code is used unless it is the generic LOT_Error, saving a LOT_get_last_error() call.
+	int checkStatus(int rc, const LOTHandle& h, const char* function, LOTError& error)
+	{
+		error.code = rc;
+		error.address = 0;
+		error.id = h.id;
+		if (rc == LOT_OK)
+		{
+			return rc;
+		}
+		if (rc == LOT_Error)
+		{
+			int code, address;
+			char myid[BUFFER_SIZE];
+			if (LOT_get_last_error(&code, myid, &address) == LOT_OK)
+			{
+				error.code = code;
+				error.address = address;
+			}
+		}
+		countError(function, error);
+		return error.code;
+	}
+
+}
+
+std::string LOTError::message() const
+{
+	char buffer[BUFFER_SIZE + 64];
+	epicsSnprintf(buffer, sizeof(buffer), "id='%.*s' error=%d (%s) address=%d", BUFFER_SIZE - 1, (id != NULL ? id : ""), code, lookupError(code), address);
+	return buffer;
+}
+
 #define LOT_CHECK(__val) \
 { \
-    if ( (__val) != LOT_OK ) \
+	int __rc = (__val); \
+	if (__rc != LOT_OK) \
 	{ \
-		std::stringstream message; \
-        int errCode, address; \
-	    char myid[BUFFER_SIZE]; \
-	    myid[sizeof(myid) - 1] = '\0'; \
-	    if (LOT_get_last_error(&errCode, myid, &address) == LOT_OK) \
-		{ \
-	        myid[sizeof(myid) - 1] = '\0'; \
-			message << "id='" << myid << "' error=" << errCode << " (" << lookupError(errCode) << ") address=" << address; \
-		} \
-		else \
-		{ \
-			message << "unknown error"; \
-		} \
-		std::cerr << "LOT: " << __FUNCTION__ << "[\"" << __FILE__ << "\"/" << __LINE__ << "] " << message.str() << std::endl; \
-		throw LOTException(message.str(), errCode, myid, address); \
+		throwError(__rc, __FUNCTION__); \
 	} \
 }
 
-static void split_string(const std::string& s, std::list<std::string>& splits)
+void LOTUtils::split_string(const std::string& s, std::list<std::string>& splits)
 {
 	boost::split(splits, s, boost::is_any_of(","), boost::token_compress_on);
 	splits.remove(""); // remove blanks	
@@ -139,6 +247,12 @@ void LOTUtils::get(const std::string& id, int token, int _index, double &value)
 	LOT_CHECK(LOT_get(id.c_str(), token, _index, &value));
 }
 
+/// Read through a pre-resolved handle; makes no heap allocation unless the call fails
+void LOTUtils::get(const LOTHandle& h, double& value)
+{
+	LOT_CHECK(LOT_get(h.id, h.token, h.index, &value));
+}
+
 void LOTUtils::get_comms_list(std::list<std::string>& list)
 {
 	char buffer[BUFFER_SIZE];
@@ -185,6 +299,24 @@ void LOTUtils::get_str(const std::string& id, int token, int _index, std::string
 	s = buffer;
 }
 
+/// Read a string through a pre-resolved handle into \a buffer, of at least LOT_BUFFER_SIZE characters; makes no heap
+/// allocation unless the call fails
+void LOTUtils::get_str(const LOTHandle& h, char* buffer)
+{
+	buffer[LOT_BUFFER_SIZE - 1] = '\0';
+	LOT_CHECK(LOT_get_str(h.id, h.token, h.index, buffer));
+	buffer[LOT_BUFFER_SIZE - 1] = '\0';
+}
+
+/// A copy of \a id that is never freed, the same pointer for every call with the same id, for a LOTHandle
+const char* LOTUtils::intern(const std::string& id)
+{
+	static epicsMutex lock;
+	static std::set<std::string> ids; // a set never moves its elements, so the pointers stay valid
+	epicsGuard<epicsMutex> guard(lock);
+	return ids.insert(id).first->c_str();
+}
+
 void LOTUtils::recalibrate(const std::string& id, int _index, double Wavelength, double CorrectWavelength, int& OldZord, int& NewZord)
 {
 	LOT_CHECK(LOT_recalibrate(id.c_str(), _index, Wavelength, CorrectWavelength, &OldZord, &NewZord));
@@ -210,6 +342,16 @@ void LOTUtils::set_str(const std::string& id, int token, int _index, const std::
 	LOT_CHECK(LOT_set_str(id.c_str(), token, _index, s.c_str()));
 }
 
+void LOTUtils::set(const LOTHandle& h, double value)
+{
+	LOT_CHECK(LOT_set(h.id, h.token, h.index, &value));
+}
+
+void LOTUtils::set_str(const LOTHandle& h, const char* s)
+{
+	LOT_CHECK(LOT_set_str(h.id, h.token, h.index, s));
+}
+
 void LOTUtils::set_c_group(int group)
 {
 	LOT_CHECK(LOT_set_c_group(group));
@@ -223,3 +365,52 @@ void LOTUtils::version(std::string& version)
 	buffer[sizeof(buffer) - 1] = '\0';
 	version = buffer;
 }
+
+/// Read through \a h as get() does, but return the error code, LOT_OK on success, and fill in \a error rather than throw
+int LOTUtils::try_get(const LOTHandle& h, double& value, LOTError& error)
+{
+	return checkStatus(LOT_get(h.id, h.token, h.index, &value), h, "get", error);
+}
+
+int LOTUtils::try_get_str(const LOTHandle& h, char* buffer, LOTError& error)
+{
+	buffer[LOT_BUFFER_SIZE - 1] = '\0';
+	int rc = checkStatus(LOT_get_str(h.id, h.token, h.index, buffer), h, "get_str", error);
+	buffer[LOT_BUFFER_SIZE - 1] = '\0';
+	return rc;
+}
+
+int LOTUtils::try_set(const LOTHandle& h, double value, LOTError& error)
+{
+	return checkStatus(LOT_set(h.id, h.token, h.index, &value), h, "set", error);
+}
+
+int LOTUtils::try_set_str(const LOTHandle& h, const char* s, LOTError& error)
+{
+	return checkStatus(LOT_set_str(h.id, h.token, h.index, s), h, "set_str", error);
+}
+
+/// Whether SDK error \a code means the hardware has gone away, so every call will fail until the SDK is reopened
+bool LOTUtils::comms_lost(int code)
+{
+	return (code == LOT_Error_USB_Disconnected || code == LOT_USB_Comms_Error || code == LOT_Error_IMAC_timeout);
+}
+
+/// The number of failed SDK calls since the IOC started
+unsigned long LOTUtils::error_count()
+{
+	epicsGuard<epicsMutex> guard(errorLock());
+	return error_total;
+}
+
+/// Print the number of failures of each id and error code
+void LOTUtils::error_report(FILE* fp)
+{
+	epicsGuard<epicsMutex> guard(errorLock());
+	fprintf(fp, "LOT: %lu SDK calls failed\n", error_total);
+	for (ErrorCounts::const_iterator it = errorCounts().begin(); it != errorCounts().end(); ++it)
+	{
+		fprintf(fp, "  id='%s' error=%d (%s) %lu times\n", (it->first.first != NULL ? it->first.first : ""), it->first.second,
+			lookupError(it->first.second), it->second.count);
+	}
+}
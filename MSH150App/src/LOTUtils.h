@@ -1,10 +1,33 @@
 #ifndef LOTUTILS_H
 #define LOTUTILS_H
 
-#include "LOTHw.h"
+#include "LOTHW.h"
 
 #include <shareLib.h>
 
+#define LOT_BUFFER_SIZE 256 ///< size of the buffers the SDK fills with strings and lists
+
+/// An SDK attribute (id, token, index) resolved once, for calls that must not allocate: the id is interned by LOTUtils::intern()
+/// so it stays valid, and can be passed straight to the SDK, for the life of the process
+struct LOTHandle
+{
+	const char* id;
+	int token;
+	int index;
+};
+
+/// The outcome of a call made through one of the non-throwing LOTUtils::try_ functions: a few integers, so a failing
+/// call costs no allocation; message() gives the text a LOTException would have had
+struct epicsShareClass LOTError
+{
+	int code; ///< LOT_OK if the call succeeded, otherwise the SDK error code
+	int address;
+	const char* id; ///< interned id of the item called, or NULL
+	LOTError() : code(LOT_OK), address(0), id(NULL) { }
+	bool ok() const { return code == LOT_OK; }
+	std::string message() const;
+};
+
 struct epicsShareClass LOTUtils
 {
 	static void build_system_model(const std::string& xmlfile);
@@ -13,6 +36,8 @@ struct epicsShareClass LOTUtils
 
 	static void get(const std::string& id, int token, int _index, double &value);
 
+	static void get(const LOTHandle& h, double& value);
+
 	static void get_comms_list(std::list<std::string>& list);
 
 	static void initialise();
@@ -25,6 +50,10 @@ struct epicsShareClass LOTUtils
 
 	static void get_str(const std::string& id, int token, int _index, std::string& s);
 
+	static void get_str(const LOTHandle& h, char* buffer);
+
+	static const char* intern(const std::string& id);
+
 	static void recalibrate(const std::string& id, int _index, double Wavelength, double CorrectWavelength, int& OldZord, int& NewZord);
 
 	static void save_setup();
@@ -35,10 +64,30 @@ struct epicsShareClass LOTUtils
 
 	static void set_str(const std::string& id, int token, int _index, const std::string& s);
 
+	static void set(const LOTHandle& h, double value);
+
+	static void set_str(const LOTHandle& h, const char* s);
+
 	static void set_c_group(int group);
 
 	static void version(std::string& version);
 
+	static void split_string(const std::string& s, std::list<std::string>& splits);
+
+	static int try_get(const LOTHandle& h, double& value, LOTError& error);
+
+	static int try_get_str(const LOTHandle& h, char* buffer, LOTError& error);
+
+	static int try_set(const LOTHandle& h, double value, LOTError& error);
+
+	static int try_set_str(const LOTHandle& h, const char* s, LOTError& error);
+
+	static bool comms_lost(int code);
+
+	static unsigned long error_count();
+
+	static void error_report(FILE* fp);
+
 };
 
 class epicsShareClass LOTException : public std::runtime_error
@@ -51,6 +100,7 @@ class epicsShareClass LOTException : public std::runtime_error
     public:
 	    explicit LOTException(const std::string& message, int errcode, const std::string& id, int address) : std::runtime_error(message), m_id(id), m_errcode(errcode), m_address(address)  {}
 		std::string lotErrMsg() const;
+		int errcode() const { return m_errcode; }
 };
 
 #endif /* LOTUTILS_H */
@@ -1,69 +1,378 @@
+/// @file test.cpp LOT SDK latency characterisation tool.
+///
+/// Walks the hardware tree, times repeated LOTUtils::get / get_str calls for every (id, token, index)
+/// the driver polls, times select_wavelength moves across each grating, filter and SAM switch
+/// wavelength, and writes p50/p99/max plus a latency histogram for each as CSV.
+///
+/// usage: LOTCharacterise [-n repeats] [-o file.csv] [-s] system_model.xml
+///   -s  put the comms objects into SimulationMode first
+
 #include <string>
 #include <iostream>
 #include <list>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
 #include "LOTUtils.h"
+#include "LOTStats.h"
+
+namespace {
+
+	struct Result
+	{
+		std::string op;
+		std::string id;
+		std::string what;
+		int index;
+		std::vector<double> samples;
+		LOTLatencyStats stats;
+		Result(const std::string& o, const std::string& i, const std::string& w, int idx) : op(o), id(i), what(w), index(idx) { }
+	};
+
+	/// a switch wavelength at which select_wavelength changes grating, filter or SAM state
+	struct Boundary
+	{
+		std::string id;
+		std::string what;
+		double wl;
+		Boundary(const std::string& i, const std::string& w, double d) : id(i), what(w), wl(d) { }
+	};
+
+	double elapsed(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	double exactPercentile(std::vector<double> v, double p)
+	{
+		if (v.size() == 0)
+		{
+			return 0.0;
+		}
+		std::sort(v.begin(), v.end());
+		size_t n = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+		return v[n];
+	}
+
+	std::string tokenName(int token)
+	{
+		char buffer[16];
+		switch (token)
+		{
+		case MonochromatorCurrentWL: return "MonochromatorCurrentWL";
+		case MonochromatorCurrentGrating: return "MonochromatorCurrentGrating";
+		case MonochromatorModeSwitchNum: return "MonochromatorModeSwitchNum";
+		case MonochromatorModeSwitchState: return "MonochromatorModeSwitchState";
+		case MonochromatorCanModeSwitch: return "MonochromatorCanModeSwitch";
+		case MonochromatorAutoSelectWavelength: return "MonochromatorAutoSelectWavelength";
+		case MonochromatorNumTurrets: return "MonochromatorNumTurrets";
+		case TurretNumGratings: return "TurretNumGratings";
+		case GratingSwitchWL: return "GratingSwitchWL";
+		case FWheelFilter: return "FWheelFilter";
+		case FWheelPositions: return "FWheelPositions";
+		case FWheelCurrentPosition: return "FWheelCurrentPosition";
+		case SAMSwitchWL: return "SAMSwitchWL";
+		case SAMCurrentState: return "SAMCurrentState";
+		case SimulationMode: return "SimulationMode";
+		case lotMoveWithWavelength: return "lotMoveWithWavelength";
+		case lotDescriptor: return "lotDescriptor";
+		default:
+			sprintf(buffer, "%d", token);
+			return buffer;
+		}
+	}
+
+	class Characterise
+	{
+	public:
+		Characterise(int repeats) : m_repeats(repeats) { }
+
+		void timeGet(const std::string& id, int token, int index = 0)
+		{
+			Result r("get", id, tokenName(token), index);
+			for (int i = 0; i < m_repeats; ++i)
+			{
+				double d;
+				bool ok = true;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				try
+				{
+					LOTUtils::get(id, token, index, d);
+				}
+				catch (const std::exception&)
+				{
+					ok = false;
+				}
+				add(r, elapsed(start), ok);
+			}
+			m_results.push_back(r);
+		}
+
+		void timeGetStr(const std::string& id, int token, int index = 0)
+		{
+			Result r("get_str", id, tokenName(token), index);
+			for (int i = 0; i < m_repeats; ++i)
+			{
+				std::string s;
+				bool ok = true;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				try
+				{
+					LOTUtils::get_str(id, token, index, s);
+				}
+				catch (const std::exception&)
+				{
+					ok = false;
+				}
+				add(r, elapsed(start), ok);
+			}
+			m_results.push_back(r);
+		}
+
+		/// time moves from just below to just above \a boundary, and a move of the same size that stays on one side
+		void timeBoundary(const std::string& id, const std::string& what, int index, double boundary)
+		{
+			static const double step = 1.0;
+			if (boundary - step < 0.0)
+			{
+				return;
+			}
+			Result cross("select_wavelength", id, what + ":cross", index), within("select_wavelength", id, what + ":within", index);
+			for (int i = 0; i < m_repeats; ++i)
+			{
+				timeMove(boundary - step, NULL);
+				timeMove(boundary + step, &cross);
+				timeMove(boundary + 2.0 * step, &within);
+			}
+			m_results.push_back(cross);
+			m_results.push_back(within);
+		}
+
+		void write(FILE* fp) const
+		{
+			fprintf(fp, "op,id,token,index,count,errors,mean_ms,p50_ms,p99_ms,max_ms,");
+			LOTLatencyStats::print_header(fp);
+			fprintf(fp, "\n");
+			for (auto r = m_results.cbegin(); r != m_results.cend(); ++r)
+			{
+				fprintf(fp, "%s,%s,%s,%d,%ld,%ld,%.3f,%.3f,%.3f,%.3f,", r->op.c_str(), r->id.c_str(), r->what.c_str(), r->index,
+					r->stats.count(), r->stats.errors(), r->stats.mean() * 1e3, exactPercentile(r->samples, 0.5) * 1e3,
+					exactPercentile(r->samples, 0.99) * 1e3, r->stats.max() * 1e3);
+				r->stats.print_bins(fp);
+				fprintf(fp, "\n");
+			}
+		}
+
+	private:
+		int m_repeats;
+		std::vector<Result> m_results;
+
+		static void add(Result& r, double t, bool ok)
+		{
+			r.samples.push_back(t);
+			r.stats.add(t, ok);
+		}
+
+		static void timeMove(double wl, Result* r)
+		{
+			bool ok = true;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			try
+			{
+				LOTUtils::select_wavelength(wl);
+			}
+			catch (const std::exception&)
+			{
+				ok = false;
+			}
+			if (r != NULL)
+			{
+				add(*r, elapsed(start), ok);
+			}
+		}
+	};
+
+	int readCount(const std::string& id, int token)
+	{
+		double d = 0.0;
+		LOTUtils::get(id, token, 0, d);
+		return static_cast<int>(d);
+	}
+
+	/// the parameters LOTPortDriver::addHardwareParams() polls for \a item, plus its switch wavelengths
+	void walk(Characterise& c, const std::string& item, std::list<Boundary>& boundaries)
+	{
+		int hardware_type, n;
+		double d;
+		std::list<std::string> mono_items;
+		LOTUtils::get_hardware_type(item, hardware_type);
+		switch (hardware_type)
+		{
+		case lotInterface:
+			std::cerr << "lotInterface " << item << std::endl;
+			break;
+		case lotSAM:
+			std::cerr << "lotSAM " << item << std::endl;
+			c.timeGet(item, SAMCurrentState);
+			try
+			{
+				LOTUtils::get(item, SAMSwitchWL, 0, d);
+				boundaries.push_back(Boundary(item, "sam", d));
+			}
+			catch (const std::exception&)
+			{
+			}
+			break;
+		case lotSlit:
+			std::cerr << "lotSlit " << item << std::endl;
+			break;
+		case lotFilterWheel:
+			std::cerr << "lotFilterWheel " << item << std::endl;
+			c.timeGet(item, FWheelPositions);
+			n = readCount(item, FWheelPositions);
+			for (int i = 1; i <= n; ++i)
+			{
+				c.timeGet(item, FWheelFilter, i);
+				LOTUtils::get(item, FWheelFilter, i, d);
+				if (i > 1)
+				{
+					boundaries.push_back(Boundary(item, "filter" + std::to_string(i), d));
+				}
+			}
+			c.timeGet(item, FWheelCurrentPosition);
+			c.timeGet(item, lotMoveWithWavelength);
+			c.timeGetStr(item, lotDescriptor);
+			break;
+		case lotMono:
+			std::cerr << "lotMono " << item << std::endl;
+			c.timeGet(item, MonochromatorCurrentWL);
+			c.timeGet(item, MonochromatorCurrentGrating);
+			c.timeGet(item, MonochromatorModeSwitchNum);
+			c.timeGet(item, MonochromatorModeSwitchState);
+			c.timeGet(item, MonochromatorCanModeSwitch);
+			c.timeGet(item, MonochromatorAutoSelectWavelength);
+			c.timeGet(item, MonochromatorNumTurrets);
+			c.timeGet(item, TurretNumGratings);
+			n = readCount(item, TurretNumGratings);
+			for (int i = 1; i <= n; ++i)
+			{
+				c.timeGet(item, GratingSwitchWL, i);
+				LOTUtils::get(item, GratingSwitchWL, i, d);
+				if (i > 1)
+				{
+					boundaries.push_back(Boundary(item, "grating" + std::to_string(i), d));
+				}
+			}
+			c.timeGetStr(item, lotDescriptor);
+			LOTUtils::get_mono_items(item, mono_items);
+			for (const auto& m : mono_items)
+			{
+				std::cerr << "mono " << item << " item " << m << std::endl;
+				walk(c, m, boundaries);
+			}
+			break;
+		case lotUnknown:
+			std::cerr << "lotUnknown " << item << std::endl;
+			break;
+		default:
+			std::cerr << "error " << item << std::endl;
+			break;
+		}
+	}
+
+	void usage()
+	{
+		std::cerr << "usage: LOTCharacterise [-n repeats] [-o file.csv] [-s] system_model.xml" << std::endl;
+	}
+
+}
 
 int main(int argc, char* argv[])
 {
-	std::string version, s;
+	int repeats = 100;
+	bool simulate = false;
+	const char* config_file = NULL;
+	const char* csv_file = NULL;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+		{
+			repeats = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			csv_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-s"))
+		{
+			simulate = true;
+		}
+		else if (argv[i][0] != '-' && config_file == NULL)
+		{
+			config_file = argv[i];
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (config_file == NULL || repeats < 1)
+	{
+		usage();
+		return 1;
+	}
+	std::string version;
 	try {
-	    LOTUtils::version(version);
-        std::cerr << "LOT version " << version << std::endl;	
-	    LOTUtils::build_system_model("C:/Instrument/Apps/EPICS/support/MSH150/master/data/ibex_test_config.xml");
-		std::list<std::string> comms_list, hardware_list, mono_items;
-	    LOTUtils::get_comms_list(comms_list);
-		for(const auto& c : comms_list)
-		{
-			std::cerr << "comms: " << "\""<< c << "\"" << std::endl;
-	        LOTUtils::set(c, LOTTokens::SimulationMode, 0, 1);
-		}
-	    LOTUtils::initialise();
-	    LOTUtils::get_hardware_list(hardware_list);
-		for(const auto& h : hardware_list)
-		{
-			int hardware_type;
-			std::string s;
-			double d;
-			LOTUtils::get_hardware_type(h, hardware_type);
-//	        LOTUtils::get_str(h, LOTTokens::lotProductName, 0, s);
-//			std::cerr << s << std::endl;
-			switch(hardware_type)
+		LOTUtils::version(version);
+		std::cerr << "LOT version " << version << std::endl;
+		LOTUtils::build_system_model(config_file);
+		std::list<std::string> comms_list, hardware_list;
+		LOTUtils::get_comms_list(comms_list);
+		Characterise c(repeats);
+		for (const auto& comms : comms_list)
+		{
+			std::cerr << "comms: " << "\"" << comms << "\"" << std::endl;
+			if (simulate)
 			{
-				case lotInterface:
-			        std::cerr << "lotInterface" << std::endl;
-				    break;
-				case lotSAM:
-			        std::cerr << "lotSAM" << std::endl;
-				    break;
-                case lotSlit:
-			        std::cerr << "lotSlit" << std::endl;
-				    break;
-                case lotFilterWheel:
-			        std::cerr << "lotFilterWheel" << std::endl;
-				    break;
-                case lotMono:
-			        std::cerr << "lotMono " << h << std::endl;
-	                LOTUtils::get_mono_items(h, mono_items);
-		            for(const auto& m : mono_items)
-					{
-						std::cerr << "mono " << m << std::endl;
-					}
-					LOTUtils::get(h, LOTTokens::MonochromatorCurrentWL, 0, d);
-					std::cerr << d << std::endl;
-					break;
-                case lotUnknown:
-			        std::cerr << "lotUnknown" << std::endl;
-				    break;
-				default:
-			        std::cerr << "error" << std::endl;
-					break;
+				LOTUtils::set(comms, LOTTokens::SimulationMode, 0, 1);
 			}
+			c.timeGet(comms, SimulationMode);
+		}
+		LOTUtils::initialise();
+		LOTUtils::get_hardware_list(hardware_list);
+		std::list<Boundary> boundaries;
+		for (const auto& h : hardware_list)
+		{
+			walk(c, h, boundaries);
+		}
+		for (const auto& b : boundaries)
+		{
+			std::cerr << "timing moves across " << b.id << " " << b.what << " at " << b.wl << std::endl;
+			c.timeBoundary(b.id, b.what, 0, b.wl);
+		}
+		FILE* fp = (csv_file != NULL ? fopen(csv_file, "w") : stdout);
+		if (fp == NULL)
+		{
+			std::cerr << "cannot write " << csv_file << std::endl;
+			return 1;
+		}
+		c.write(fp);
+		if (fp != stdout)
+		{
+			fclose(fp);
 		}
 		LOTUtils::close();
 	}
-	catch(const std::exception& ex)
+	catch (const std::exception& ex)
 	{
 		std::cerr << ex.what() << std::endl;
+		return 1;
 	}
-    return 0;
-}
\ No newline at end of file
+	return 0;
+}
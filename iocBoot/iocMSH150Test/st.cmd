@@ -14,10 +14,42 @@ epicsEnvSet("P","$(MYPVPREFIX)")
 epicsEnvSet("Q","MSH150_01:")
 
 #LOTConfigure("L0", "$(TOP)/data/ibex_test_config.xml", "$(TOP)/db/LOT.substitutions", 1)
+## on hosts without the vendor DLL the driver is built against the simulated SDK, see LOTHWSim.h
+#epicsEnvSet("LOTSIM_LATENCY", "scale=0.1")
+#LOTConfigure("L0", "$(TOP)/data/LOTSim_config.xml", "$(TOP)/db/LOT.substitutions", 1)
+## LOT.substitutions can also be generated ahead of time, without the SDK, by
+##   LOTMakeSubstitutions -P $(MYPVPREFIX) -Q MSH150_01: -p L0 -o LOT.substitutions system_model.xml
+## which refuses a model with items or elements it does not recognise; check its output against a vendor model file with
+##   LOTMakeSubstitutions -P $(MYPVPREFIX) -Q MSH150_01: -p L0 -c $(TOP)/db/LOT.substitutions system_model.xml
+## after LOTConfigure() has written LOT.substitutions from the SDK, which also logs any difference it finds
+## the parameter layout is cached in the substitutions file name with .layout appended, and reused while the system model
+## XML, port, P and Q are unchanged; a fifth options argument of 1 ignores the cache and enumerates the hardware again
+## indexed attributes (filter wavelengths, grating switch wavelengths) are also published as one waveform each; an
+## options bit of 2 leaves out their per-index records, as does LOTMakeSubstitutions -n
 LOTConfigure("L0", "C:/Users/Public/Documents/LOT/Monochromator Control/Configurations/ccgData_LOT_MSH-150_SN25606.xml", "$(TOP)/db/LOT.substitutions", 0)
+## several ports can share the SDK, one per comms group of the same system model, given as a sixth argument;
+## LOTMakeSubstitutions takes it as -g group
+#LOTConfigure("L1", "$(TOP)/data/two_monochromators.xml", "$(TOP)/db/LOT1.substitutions", 0, 0, 1)
+#LOTConfigure("L2", "$(TOP)/data/two_monochromators.xml", "$(TOP)/db/LOT2.substitutions", 0, 0, 2)
+## seconds between polls of fast (wavelength, grating, positions) and slow changing parameters
+#LOTSetPollPeriods("L0", 0.5, 5.0)
+## poll every 0.05s while moving, until 2s after the move request and the wavelength is within 0.01 of the setpoint
+#LOTSetMovePoll("L0", 0.05, 2.0, 0.01)
+## record reads return values polled or read less than 0.5s ago without another SDK call
+#LOTSetCacheMaxAge("L0", 0.5)
+## after a USB disconnect, comms error or IMAC timeout, try to reopen the SDK after 1s, doubling the wait to at most 60s
+#LOTSetReconnect("L0", 1.0, 60.0)
+## stop polling a parameter after 3 failed reads in a row, then read it every 60s until it succeeds
+#LOTSetBreaker("L0", 3, 60.0)
+## only publish readings that move by more than 0.01 (absolute) or 0.1% (relative) of the last published value
+#LOTSetDeadband("L0", "*_MonochromatorCurrentWL", 0.01, 0.001)
+## fit the zero order offset of each grating to reference lines, one "grating nominal measured" per line of the file,
+## and with a third argument of 1 recalibrate with it; the CAL: records do the same at runtime and CAL:ROLLBACK:SP undoes it
+#LOTCalibrate("L0", "$(TOP)/data/calibration_lines.txt", 0)
 
 ## Load record instances
 dbLoadRecords("$(TOP)/db/MSH150.db","P=$(MYPVPREFIX),Q=MSH150_01:,PORT=L0")
+dbLoadRecords("$(TOP)/db/LOT_diag.template","P=$(MYPVPREFIX),Q=MSH150_01:,PORT=L0")
 dbLoadTemplate("$(TOP)/db/LOT.substitutions")
 
 iocInit()